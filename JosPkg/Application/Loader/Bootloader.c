@@ -42,6 +42,16 @@
     EFI_FILE_INFO            *FileMeta;                       // Kernel file metadata
     EFI_CONFIGURATION_TABLE  *ConfigTables;                   // UEFI-installed system configuration tables (ACPI, SMBIOS, etc.)
     UINTN                     Number_of_ConfigTables;         // The number of system configuration tables
+
+    BOOT_TIMING               Boot_Timing;                    // TSC stamps of each boot phase so far, see Bootloader.h
+
+    MEMORY_RANGE             *Memory_Ranges;                  // The memory map sorted by address with same-type neighbours merged, see Bootloader.h
+    UINTN                     Number_of_Memory_Ranges;        // The number of entries in it
+
+    EFI_PHYSICAL_ADDRESS      Page_Directory;                 // Initial 4 MiB-page directory for CR3, or 0, see Bootloader.h
+
+    BOOT_MODULE              *Modules;                        // Files listed after the command line in Kernel64.txt, see Bootloader.h
+    UINTN                     Number_of_Modules;              // The number of entries in it
   } LOADER_PARAMS;
 */
 //
@@ -97,9 +107,8 @@
 //    NOTE: You should be sure your system supports booting from external media if you are using a USB drive, and ensure that the system is
 //    not configured to boot in Legacy or BIOS mode (i.e. it has UEFI booting enabled). Also, spaces in file/folder names are not allowed.
 //
-// That's it! If your kernel file's entry point function is something like **main_function(LOADER_PARAMS * LP)**, it should load after you
-// select how you want your graphics output device(s) configured. See https://github.com/KNNSpeed/Simple-Kernel for an example, including
-// proper compilation options.
+// That's it! If your kernel file's entry point function is something like **main_function(LOADER_PARAMS * LP)**, it should load without
+// any key presses. See https://github.com/KNNSpeed/Simple-Kernel for an example, including proper compilation options.
 //
 //----------------------------------------------------------------------------------------------------------------------------------
 // Kernel64.txt Format and Contents:
@@ -119,6 +128,9 @@
 // of Linux arguments). The third line should be blank--and make sure there is a third line, as this program expects a line break to
 // denote the end of the kernel arguments.**
 //
+// The loader reads one option from the second line itself: "gop=" picks the graphics mode (current, max, WxH, WxH+ or ask; see
+// GOP_POLICY in Bootloader.h). Without it, the mode the firmware set up is kept.
+//
 // That's it!
 //
 // ** Technically you could use the remainder of the text file to contain an actual text document. You could put this info in there if
@@ -163,6 +175,8 @@ EFI_STATUS UefiMain(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
 
   EFI_STATUS Status;
 
+  BootStamp(BOOT_STAMP_LOADER_ENTRY);
+
 #ifdef DISABLE_UEFI_WATCHDOG_TIMER
   // Disable watchdog timer for debugging
   Status = gBS->SetWatchdogTimer (0, 0, 0, NULL);
@@ -328,18 +342,9 @@ EFI_STATUS UefiMain(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
   Print(L"Graphics struct allocated\r\n");
 #endif
 
-  // Set up graphics
-  Status = InitUEFI_GOP(ImageHandle, Graphics);
-  if(EFI_ERROR(Status))
-  {
-    Print(L"InitUEFI_GOP error. 0x%llx\r\n", Status);
-    Keywait(L"\0");
-    return Status;
-  }
+  // Graphics get set up in GoTime(), once Kernel64.txt has said which mode to use
 
 #ifdef MAIN_DEBUG_ENABLED
-  Keywait(L"InitUEFI_GOP finished.\r\n");
-
   // Data verification
   Print(L"Config table address: 0x%llx\r\n", gST->ConfigurationTable);
   Print(L"Data at RSDP (first 16 bytes): 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(gST->ConfigurationTable[RSDP_index].VendorTable + 8), *(EFI_PHYSICAL_ADDRESS*)gST->ConfigurationTable[RSDP_index].VendorTable);
@@ -362,7 +367,10 @@ EFI_STATUS UefiMain(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
 //
 // Note: Does not take format modifier arguments like %s, %d, etc., only plain strings.
 //
+// Only debug builds have it; otherwise Keywait() compiles to nothing (see KEYWAIT_ENABLED in Bootloader.h).
+//
 
+#ifdef KEYWAIT_ENABLED
 EFI_STATUS Keywait(CHAR16 *String)
 {
   EFI_STATUS Status;
@@ -396,3 +404,4 @@ EFI_STATUS Keywait(CHAR16 *String)
 
   return Status;
 }
+#endif
@@ -43,9 +43,13 @@
 
 #include <Library/DevicePathLib.h>
 #include <Library/BaseMemoryLib.h>
+#include <Library/BaseLib.h>
 
+// Bump MINOR_VER whenever fields are appended to LOADER_PARAMS: the kernel reads a field only if the loader's version is at least
+// the one that introduced it (LOADER_PARAMS_HAS in the kernel's inc/uefi.h). 2.3 added Boot_Timing, 2.4 Memory_Ranges,
+// 2.5 Page_Directory, 2.6 Modules.
 #define MAJOR_VER 2
-#define MINOR_VER 2
+#define MINOR_VER 6
 
 //==================================================================================================================================
 // Useful Debugging Code
@@ -78,6 +82,12 @@
     #define MEMMAP_PRINT_ENABLED
     #define MEMORY_CHECK_INFO
 //    #define MEMORY_DEBUG_ENABLED // Potential massive performance hit when enabling this and searching for free RAM page-by-page (it prints them all out)
+//    #define MEMORY_TIMING_DEBUG_ENABLED // Print how long each VerifyZeroMem (and each page-sized or larger compare) took
+#endif
+
+// Keywait() pauses only exist in debug builds (Debug Lite included). A release build must reach the kernel without a key press.
+#if defined(ENABLE_DEBUG) || defined(FINAL_LOADER_DEBUG_ENABLED)
+  #define KEYWAIT_ENABLED
 #endif
 
 //==================================================================================================================================
@@ -100,6 +110,20 @@
 #undef MEMORY_CHECK_DISABLED
 #endif
 
+// Read the kernel file front to back in one pass of STREAM_CHUNK_SIZE reads instead of one SetPosition() + Read() per segment (see Stream.c)
+// Comment out for the per-segment loader. Chunks of 1-4 MiB work well; they must be a multiple of the page size.
+#define STREAMING_ELF_LOAD
+#define STREAM_CHUNK_SIZE 0x200000
+
+// Load the compressed kernel container (kernel path + ".lz4", see Lz4.c) instead of the kernel ELF when there is one
+#define PACKED_KERNEL_LOAD
+
+// Print how long loading the kernel's segments took and how much zeroing was skipped (TSC-timed, see Timer.c). The TSC calibration
+// behind the microsecond figures Stall()s for 10 ms, so this comes with debug mode only.
+#ifdef ENABLE_DEBUG
+#define LOAD_TIME_INFO
+#endif
+
 //==================================================================================================================================
 // Text File UCS-2 Definitions
 //==================================================================================================================================
@@ -138,6 +162,88 @@ typedef struct {
   UINT64                              NumberOfFrameBuffers; // The number of pointers in the array (== the number of available framebuffers)
 } GPU_CONFIG;
 
+//
+// Boot timing: the loader records a TSC stamp as it finishes each phase of booting and hands them over in LOADER_PARAMS; the kernel
+// appends stamps of its own to the same array. Stamps are in the order they were taken. Bump BOOT_TIMING_VERSION whenever the layout
+// below changes (inc/uefi.h has the kernel's copy), so a kernel never misreads a block from a different loader.
+//
+
+#define BOOT_TIMING_VERSION     1
+#define BOOT_TIMING_MAX_STAMPS  16
+
+#define BOOT_STAMP_LOADER_ENTRY   0  // UefiMain() entered
+#define BOOT_STAMP_GOP_START      1  // About to set up graphics
+#define BOOT_STAMP_GOP_DONE       2  // Graphics set up
+#define BOOT_STAMP_CONFIG_PARSED  3  // Kernel64.txt read and parsed
+#define BOOT_STAMP_LOAD_START     4  // Kernel file opened
+#define BOOT_STAMP_LOAD_DONE      5  // Kernel segments in memory
+#define BOOT_STAMP_EXIT_BOOT      6  // About to get the final memory map and exit boot services
+#define BOOT_STAMP_KERNEL_JUMP    7  // Boot services gone, jumping to the kernel
+#define BOOT_STAMP_KERNEL_ENTRY   8  // Kernel entered (kernel stamps from here on)
+#define BOOT_STAMP_CONSOLE        9  // Kernel console up
+#define BOOT_STAMP_MEMORY_MAP     10 // Kernel memory map set up
+#define BOOT_STAMP_TRAPS          11 // Kernel traps and interrupt controller set up
+
+typedef struct {
+  UINT32                    Id;                             // One of the BOOT_STAMP_* values above
+  UINT32                    Reserved;
+  UINT64                    Tsc;                            // Time stamp counter when the phase ended
+} BOOT_STAMP;
+
+typedef struct {
+  UINT32                    Version;                        // BOOT_TIMING_VERSION
+  UINT32                    Count;                          // The number of valid entries in Stamps
+  UINT64                    TscPerMs;                       // TSC ticks per millisecond as calibrated against Stall(), or 0 if the loader never calibrated
+  BOOT_STAMP                Stamps[BOOT_TIMING_MAX_STAMPS];
+} BOOT_TIMING;
+
+//
+// The coalesced memory map: the firmware's final memory map sorted by address, with neighbouring ranges of the same type merged, so
+// the kernel can set up its allocator in one pass over a handful of ranges. Built after ExitBootServices() (see CoalesceMemoryMap() in
+// Memory.c). Boot services code and data are free for the kernel to use once it no longer needs anything in them, so they are flagged
+// MEMORY_RANGE_RECLAIMABLE.
+//
+
+#define MEMORY_RANGE_RECLAIMABLE  0x1
+#define MEMORY_RANGE_SLACK        16 // Extra ranges to make room for, since the map can grow between sizing it and exiting boot services
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      PhysicalStart;                  // Page-aligned start of the range
+  UINT64                    NumberOfPages;                  // Its length in 4 KiB pages
+  UINT32                    Type;                           // EFI_MEMORY_TYPE
+  UINT32                    Flags;                          // MEMORY_RANGE_* flags
+} MEMORY_RANGE;
+
+//
+// The initial page directory: one 4 KiB page of 32-bit PSE entries, each mapping a 4 MiB page, so the kernel can turn paging on with a
+// CR3 load instead of building tables itself (see BuildPageDirectory() in Memory.c). RAM and framebuffers are identity mapped, and the
+// first 256 MiB of physical memory is also mapped at LOADER_HIGH_HALF_BASE wherever that doesn't collide with the identity map.
+// Framebuffer entries set the PAT bit, selecting PAT entry 4, which the kernel can make write-combining.
+//
+
+#define PDE_PRESENT               0x001
+#define PDE_WRITE                 0x002
+#define PDE_LARGE                 0x080 // 4 MiB page (needs CR4.PSE)
+#define PDE_LARGE_PAT             0x1000 // PAT index bit 2 for a 4 MiB page
+#define PDE_LARGE_SHIFT           22
+#define LOADER_HIGH_HALF_BASE     0xF0000000ULL
+
+//
+// Boot modules: files listed one per line after the command line in Kernel64.txt, each loaded into its own page-aligned EfiLoaderData
+// pages (see LoadBootModules() in Module.c) so the kernel can map or use them in place. Modules that fail to load are left out.
+//
+
+#define BOOT_MODULES_MAX          16
+#define BOOT_MODULE_NAME_LEN      48 // Including the NUL
+#define BOOT_MODULE_PATH_LEN      256
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      Base;                           // Page-aligned start of the module's data (0 for an empty file)
+  UINT64                    Size;                           // Its length in bytes; the rest of the last page is zero
+  UINT64                    Pages;                          // The number of 4 KiB pages allocated for it
+  CHAR8                     Name[BOOT_MODULE_NAME_LEN];     // The file name without its directory, as ASCII
+} BOOT_MODULE;
+
 typedef struct {
   UINT32                    UEFI_Version;                   // The system UEFI version
   UINT32                    Bootloader_MajorVersion;        // The major version of the bootloader
@@ -163,8 +269,106 @@ typedef struct {
   EFI_FILE_INFO            *FileMeta;                       // Kernel file metadata
   EFI_CONFIGURATION_TABLE  *ConfigTables;                   // UEFI-installed system configuration tables (ACPI, SMBIOS, etc.)
   UINTN                     Number_of_ConfigTables;         // The number of system configuration tables
+
+  BOOT_TIMING               Boot_Timing;                    // TSC stamps of each boot phase so far; see BOOT_TIMING above
+
+  MEMORY_RANGE             *Memory_Ranges;                  // The coalesced memory map; see MEMORY_RANGE above
+  UINTN                     Number_of_Memory_Ranges;        // The number of entries in it (0 if it couldn't be built)
+
+  EFI_PHYSICAL_ADDRESS      Page_Directory;                 // Initial 4 MiB-page directory for CR3; see PDE_* above (0 if there isn't one)
+
+  BOOT_MODULE              *Modules;                        // Boot modules from Kernel64.txt; see BOOT_MODULE above
+  UINTN                     Number_of_Modules;              // The number of entries in it
 } LOADER_PARAMS;
 
+//==================================================================================================================================
+// Free Memory Search
+//==================================================================================================================================
+//
+// State for walking the free memory ranges when the kernel's preferred address turns out not to be usable. See Memory.c.
+//
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      Start;
+  UINT64                    Pages;
+} FREE_RANGE;
+
+typedef struct {
+  UINT64                    Pages;                          // The number of contiguous pages being searched for
+  BOOLEAN                   ByPage;                         // Also try every page address within each range, not just its start
+  BOOLEAN                   Started;                        // Whether Last is valid yet
+  EFI_PHYSICAL_ADDRESS      Last;                           // The last candidate address handed out
+  FREE_RANGE               *Ranges;                         // EfiConventionalMemory ranges of at least Pages pages, sorted by address
+  UINTN                     Count;                          // The number of entries in Ranges
+  UINTN                     Index;                          // The entry in Ranges the next candidate comes from
+  UINTN                     MapKey;                         // The memory map key the snapshot was taken under
+  EFI_MEMORY_DESCRIPTOR    *MemMap;                         // GetMemoryMap buffer, reused when the map is read again
+  UINTN                     MemMapBufferSize;               // The size of the above buffer
+} FREE_RANGE_ITER;
+
+//==================================================================================================================================
+// Graphics Mode Policy
+//==================================================================================================================================
+//
+// How InitUEFI_GOP() picks each framebuffer's mode, from the "gop=" kernel option on the second line of Kernel64.txt:
+//
+//  gop=current  Keep the mode the firmware already set (the default, and the fastest: no SetMode unless there's no framebuffer yet)
+//  gop=max      The mode with the most pixels
+//  gop=WxH      Exactly W by H, or the current mode if there is no such mode
+//  gop=WxH+     The smallest mode at least W by H, or the largest mode if none is that big
+//  gop=ask      The interactive menu (single GPU only; waits for a key press)
+//
+// Modes without a linear framebuffer (PixelBltOnly) are never picked.
+//
+
+typedef enum {
+  GopPolicyCurrent,
+  GopPolicyMax,
+  GopPolicyExact,
+  GopPolicyAtLeast,
+  GopPolicyAsk
+} GOP_POLICY_TYPE;
+
+typedef struct {
+  GOP_POLICY_TYPE           Type;
+  UINT32                    Width;                          // For GopPolicyExact and GopPolicyAtLeast
+  UINT32                    Height;
+} GOP_POLICY;
+
+//==================================================================================================================================
+// Compressed Kernel Container
+//==================================================================================================================================
+//
+// Built by kern/mklz4.pl; the loader uses it instead of the kernel ELF when it finds one at the kernel's path + ".lz4". The header
+// is followed by PrefixSize bytes of the ELF file (its ELF and program headers, verbatim), NumBlocks PACKED_KERNEL_BLOCKs, and
+// then the raw LZ4 blocks themselves, back to back. All fields are little endian.
+//
+
+#define PACKED_KERNEL_MAGIC   SIGNATURE_32('J', 'L', 'Z', '4')
+#define PACKED_KERNEL_VERSION 1
+#define PACKED_KERNEL_SUFFIX  L".lz4"
+
+typedef struct {
+  UINT32                    Magic;                          // PACKED_KERNEL_MAGIC
+  UINT32                    Version;                        // PACKED_KERNEL_VERSION
+  UINT32                    ElfSize;                        // The size of the kernel ELF this was made from
+  UINT32                    PrefixSize;                     // The number of ELF file bytes stored uncompressed
+  UINT32                    NumBlocks;                      // One per PT_LOAD segment with file contents
+} PACKED_KERNEL_HEADER;
+
+typedef struct {
+  UINT32                    Pa;                             // Where the segment goes (p_pa)
+  UINT32                    RawSize;                        // Its size decompressed (p_filesz)
+  UINT32                    PackedSize;                     // Its size in the container
+} PACKED_KERNEL_BLOCK;
+
+typedef struct {
+  UINTN                     FileSize;                       // The size of the whole container
+  PACKED_KERNEL_HEADER     *Header;                         // The container, as read from the file
+  UINT8                    *Prefix;                         // The uncompressed start of the ELF
+  PACKED_KERNEL_BLOCK      *Blocks;
+} PACKED_KERNEL;
+
 //==================================================================================================================================
 // Function Prototypes
 //==================================================================================================================================
@@ -172,18 +376,40 @@ typedef struct {
 // The function prototypes for the functions used in the bootloader.
 //
 
+#ifdef KEYWAIT_ENABLED
 EFI_STATUS Keywait(CHAR16 *String);
+#else
+#define Keywait(String) ((VOID)0)
+#endif
 UINT8 compare(const void* firstitem, const void* seconditem, UINT64 comparelength);
+UINT64 FirstMismatch(const void* firstitem, const void* seconditem, UINT64 comparelength);
 
-EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics);
+EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, CONST CHAR16 * Options);
 EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATION_TABLE * SysCfgTables, UINTN NumSysCfgTables, UINT32 UEFIVer);
 
 UINT8 VerifyZeroMem(UINT64 NumBytes, UINT64 BaseAddr);
-EFI_PHYSICAL_ADDRESS ActuallyFreeAddress(UINT64 pages, EFI_PHYSICAL_ADDRESS OldAddress);
-EFI_PHYSICAL_ADDRESS ActuallyFreeAddressByPage(UINT64 pages, EFI_PHYSICAL_ADDRESS OldAddress);
+UINT64 FirstNonZero(UINT64 NumBytes, UINT64 BaseAddr);
+EFI_STATUS FreeRangeIterInit(FREE_RANGE_ITER *Iter, UINT64 pages, BOOLEAN ByPage);
+EFI_STATUS AllocateNextFreeRange(FREE_RANGE_ITER *Iter, EFI_MEMORY_TYPE MemoryType, EFI_PHYSICAL_ADDRESS Avoid, EFI_PHYSICAL_ADDRESS *Address);
+VOID FreeRangeIterFree(FREE_RANGE_ITER *Iter);
+UINTN CoalesceMemoryMap(EFI_MEMORY_DESCRIPTOR *MemMap, UINTN MemMapSize, UINTN MemMapDescriptorSize, MEMORY_RANGE *Ranges, UINTN MaxRanges);
+VOID BuildPageDirectory(UINT32 *PageDirectory, MEMORY_RANGE *Ranges, UINTN NumRanges, GPU_CONFIG *Graphics);
 
 VOID print_memmap(void);
 
+EFI_STATUS OpenPackedKernel(EFI_FILE *Root, CHAR16 *KernelPath, EFI_FILE **KernelFile, PACKED_KERNEL **Packed);
+EFI_STATUS PackedKernelRead(PACKED_KERNEL *Packed, UINT64 Offset, UINTN *Size, VOID *Buffer);
+EFI_STATUS UnpackSegments(PACKED_KERNEL *Packed);
+EFI_STATUS StreamLoadSegments(EFI_FILE *KernelFile, struct Proghdr *ProgramHeaders, UINT64 NumProgramHeaders);
+EFI_STATUS StreamReadFile(EFI_FILE *File, VOID *Buffer, UINT64 Size);
+EFI_STATUS LoadBootModules(EFI_FILE *Root, CONST CHAR16 *List, BOOT_MODULE **Modules, UINTN *NumModules);
+
+UINT64 TscTicksPerMs(VOID);
+UINT64 TscToMs(UINT64 Ticks);
+UINT64 TscToUs(UINT64 Ticks);
+VOID BootStamp(UINT32 Id);
+VOID BootTimingSave(BOOT_TIMING *Dest);
+
 #ifdef GOP_NAMING_DEBUG_ENABLED
 EFI_STATUS WhatProtocols(EFI_HANDLE * HandleArray, UINTN NumHandlesInHandleArray);
 #endif
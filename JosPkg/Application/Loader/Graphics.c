@@ -21,7 +21,8 @@
 //  InitUEFI_GOP: Graphics Initialization
 //==================================================================================================================================
 //
-// Determine the UEFI-provided graphical capabilities of the machine and set the desired output mode (default is 0, usually native resolution).
+// Determine the UEFI-provided graphical capabilities of the machine and set the output mode the "gop=" option in Options asks for (default is
+// to keep the mode the firmware set up; see GOP_POLICY in Bootloader.h).
 // Writes a GPU_CONFIG structure, which contains an array of EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE structures:
 /*
   typedef struct {
@@ -99,11 +100,178 @@ LibMatchDevicePaths (
     return FALSE;
 }
 
-EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
+//==================================================================================================================================
+//  ParseGopPolicy: Graphics Mode Policy
+//==================================================================================================================================
+//
+// Find the "gop=" option among the space-separated kernel options and decode it (see GOP_POLICY in Bootloader.h). Anything that
+// doesn't parse falls back to keeping the current mode, since a boot nobody is watching shouldn't stop over a typo.
+//
+
+#define GOP_OPTION_END(c) ((c) == L'\0' || (c) == L' ')
+
+STATIC UINT32 ParseDecimal(CONST CHAR16 **String)
+{
+  UINT32 Value = 0;
+
+  while(**String >= L'0' && **String <= L'9')
+  {
+    Value = Value * 10 + (UINT32)(**String - L'0');
+    (*String)++;
+  }
+  return Value;
+}
+
+STATIC VOID ParseGopPolicy(CONST CHAR16 *Options, GOP_POLICY *Policy)
+{
+  CONST CHAR16 *Option;
+
+  Policy->Type = GopPolicyCurrent;
+  Policy->Width = 0;
+  Policy->Height = 0;
+
+  if(Options == NULL)
+  {
+    return;
+  }
+
+  for(Option = Options; *Option != L'\0'; Option++)
+  {
+    if((Option == Options || Option[-1] == L' ') && StrnCmp(Option, L"gop=", 4) == 0)
+    {
+      break;
+    }
+  }
+  if(*Option == L'\0')
+  {
+    return;
+  }
+  Option += 4;
+
+  if(StrnCmp(Option, L"current", 7) == 0 && GOP_OPTION_END(Option[7]))
+  {
+    return;
+  }
+  if(StrnCmp(Option, L"max", 3) == 0 && GOP_OPTION_END(Option[3]))
+  {
+    Policy->Type = GopPolicyMax;
+    return;
+  }
+  if(StrnCmp(Option, L"ask", 3) == 0 && GOP_OPTION_END(Option[3]))
+  {
+    Policy->Type = GopPolicyAsk;
+    return;
+  }
+
+  CONST CHAR16 *Value = Option;
+  Policy->Width = ParseDecimal(&Value);
+  if(*Value == L'x')
+  {
+    Value++;
+    Policy->Height = ParseDecimal(&Value);
+    Policy->Type = GopPolicyExact;
+    if(*Value == L'+')
+    {
+      Value++;
+      Policy->Type = GopPolicyAtLeast;
+    }
+  }
+
+  if(Policy->Width == 0 || Policy->Height == 0 || !GOP_OPTION_END(*Value))
+  {
+    Print(L"Ignoring unrecognized graphics option gop=%s\r\n", Option);
+    Policy->Type = GopPolicyCurrent;
+  }
+}
+
+//==================================================================================================================================
+//  PickGopMode: Apply the Graphics Mode Policy
+//==================================================================================================================================
+//
+// Choose a mode for one graphics output device according to Policy, without any user interaction.
+//
+
+STATIC EFI_STATUS PickGopMode(EFI_GRAPHICS_OUTPUT_PROTOCOL *GOPTable, CONST GOP_POLICY *Policy, UINT32 *Mode)
+{
+  EFI_STATUS Status;
+  EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info; // QueryMode allocates Info
+  UINTN InfoSize;
+  UINT32 Biggest = GOPTable->Mode->Mode;
+  UINT64 BiggestPixels = 0;
+  UINT64 BestPixels = 0;
+  BOOLEAN Found = FALSE;
+
+  *Mode = GOPTable->Mode->Mode;
+  if(Policy->Type == GopPolicyCurrent)
+  {
+    return EFI_SUCCESS;
+  }
+
+  for(UINT32 m = 0; m < GOPTable->Mode->MaxMode; m++) // Valid modes are from 0 to MaxMode - 1
+  {
+    Status = GOPTable->QueryMode(GOPTable, m, &InfoSize, &Info);
+    if(EFI_ERROR(Status))
+    {
+      Print(L"GraphicsTable QueryMode error. 0x%llx\r\n", Status);
+      return Status;
+    }
+    UINT32 Width = Info->HorizontalResolution;
+    UINT32 Height = Info->VerticalResolution;
+    BOOLEAN BltOnly = (Info->PixelFormat == PixelBltOnly);
+
+    Status = gBS->FreePool(Info);
+    if(EFI_ERROR(Status))
+    {
+      Print(L"Error freeing GOP mode info pool. 0x%llx\r\n", Status);
+      return Status;
+    }
+
+    if(BltOnly) // No framebuffer for the kernel to draw in
+    {
+      continue;
+    }
+
+    UINT64 Pixels = MultU64x32(Width, Height);
+    if(Pixels > BiggestPixels)
+    {
+      BiggestPixels = Pixels;
+      Biggest = m;
+    }
+
+    if(Policy->Type == GopPolicyExact && Width == Policy->Width && Height == Policy->Height)
+    {
+      *Mode = m;
+      return EFI_SUCCESS;
+    }
+
+    if(Policy->Type == GopPolicyAtLeast && Width >= Policy->Width && Height >= Policy->Height && (!Found || Pixels < BestPixels))
+    {
+      Found = TRUE;
+      BestPixels = Pixels;
+      *Mode = m;
+    }
+  }
+
+  if(Policy->Type == GopPolicyExact)
+  {
+    Print(L"No %ux%u graphics mode, keeping mode %u.\r\n", Policy->Width, Policy->Height, *Mode);
+  }
+  else if(Policy->Type == GopPolicyMax || (Policy->Type == GopPolicyAtLeast && !Found))
+  {
+    *Mode = Biggest;
+  }
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, CONST CHAR16 * Options)
 { // Declaring a pointer only allocates 8 bytes (64-bit) for that pointer. Buffers must be manually allocated memory via AllocatePool and then freed with FreePool when done with.
 
   Graphics->NumberOfFrameBuffers = 0;
 
+  GOP_POLICY Policy;
+  ParseGopPolicy(Options, &Policy);
+
   EFI_STATUS GOPStatus;
 
   UINTN GOPInfoSize;
@@ -871,18 +1039,33 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
       Keywait(L"\0");
 #endif
 
-      // Set mode 0
-      mode = 0;
-
-      Print(L"Setting graphics mode %u of %u.\r\n\n", mode + 1, GOPTable->Mode->MaxMode);
+      if(Policy.Type == GopPolicyAsk)
+      {
+        // The menu is single-GPU only; multi-GPU systems get mode 0 on every device, as they always have
+        mode = 0;
+      }
+      else
+      {
+        GOPStatus = PickGopMode(GOPTable, &Policy, &mode);
+        if(EFI_ERROR(GOPStatus))
+        {
+          return GOPStatus;
+        }
+      }
 
       // Set mode
       // This is supposed to black the screen out per spec, but apparently not every GPU got the memo.
-      GOPStatus = GOPTable->SetMode(GOPTable, mode);
-      if(EFI_ERROR(GOPStatus))
+      // Setting the mode the device is already in only costs time, unless the firmware hasn't set up a framebuffer for it yet.
+      if(mode != GOPTable->Mode->Mode || GOPTable->Mode->FrameBufferBase == 0)
       {
-        Print(L"GraphicsTable SetMode error. 0x%llx\r\n", GOPStatus);
-        return GOPStatus;
+        Print(L"Setting graphics mode %u of %u.\r\n\n", mode + 1, GOPTable->Mode->MaxMode);
+
+        GOPStatus = GOPTable->SetMode(GOPTable, mode);
+        if(EFI_ERROR(GOPStatus))
+        {
+          Print(L"GraphicsTable SetMode error. 0x%llx\r\n", GOPStatus);
+          return GOPStatus;
+        }
       }
 
 #ifdef GOP_DEBUG_ENABLED
@@ -997,6 +1180,14 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
 #endif
       mode = 0; // If there's only one mode, it's going to be mode 0.
     }
+    else if(Policy.Type != GopPolicyAsk)
+    {
+      GOPStatus = PickGopMode(GOPTable, &Policy, &mode);
+      if(EFI_ERROR(GOPStatus))
+      {
+        return GOPStatus;
+      }
+    }
     else
     {
       // Default mode
@@ -1075,11 +1266,15 @@ gBS->WaitForEvent (1, &gST->ConIn->WaitForKey, &EventIndex);
 
     // Set mode
     // This is supposed to black the screen out per spec, but apparently not every GPU got the memo.
-    GOPStatus = GOPTable->SetMode(GOPTable, mode);
-    if(EFI_ERROR(GOPStatus))
+    // Setting the mode the device is already in only costs time, unless the firmware hasn't set up a framebuffer for it yet.
+    if(mode != GOPTable->Mode->Mode || GOPTable->Mode->FrameBufferBase == 0)
     {
-      Print(L"GraphicsTable SetMode error. 0x%llx\r\n", GOPStatus);
-      return GOPStatus;
+      GOPStatus = GOPTable->SetMode(GOPTable, mode);
+      if(EFI_ERROR(GOPStatus))
+      {
+        Print(L"GraphicsTable SetMode error. 0x%llx\r\n", GOPStatus);
+        return GOPStatus;
+      }
     }
 
 #ifdef GOP_DEBUG_ENABLED
@@ -31,23 +31,6 @@
 
 EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATION_TABLE * SysCfgTables, UINTN NumSysCfgTables, UINT32 UEFIVer)
 {
-#ifdef GOP_DEBUG_ENABLED
-  // Integrity check
-  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
-  {
-    Print(L"GPU Mode: %u of %u\r\n", Graphics->GPUArray[k].Mode, Graphics->GPUArray[k].MaxMode - 1);
-    Print(L"GPU FB: 0x%016llx\r\n", Graphics->GPUArray[k].FrameBufferBase);
-    Print(L"GPU FB Size: 0x%016llx\r\n", Graphics->GPUArray[k].FrameBufferSize);
-    Print(L"GPU SizeOfInfo: %u Bytes\r\n", Graphics->GPUArray[k].SizeOfInfo);
-    Print(L"GPU Info Ver: 0x%x\r\n", Graphics->GPUArray[k].Info->Version);
-    Print(L"GPU Info Res: %ux%u\r\n", Graphics->GPUArray[k].Info->HorizontalResolution, Graphics->GPUArray[k].Info->VerticalResolution);
-    Print(L"GPU Info PxFormat: 0x%x\r\n", Graphics->GPUArray[k].Info->PixelFormat);
-    Print(L"GPU Info PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x\r\n", Graphics->GPUArray[k].Info->PixelInformation.RedMask, Graphics->GPUArray[k].Info->PixelInformation.GreenMask, Graphics->GPUArray[k].Info->PixelInformation.BlueMask, Graphics->GPUArray[k].Info->PixelInformation.ReservedMask);
-    Print(L"GPU Info PxPerScanLine: %u\r\n", Graphics->GPUArray[k].Info->PixelsPerScanLine);
-    Keywait(L"\0");
-  }
-#endif
-
 #ifdef LOADER_DEBUG_ENABLED
   Print(L"GO GO GO!!!\r\n");
 #endif
@@ -181,7 +164,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
   GoTimeStatus = CurrentDriveRoot->Open(CurrentDriveRoot, &KernelcmdFile, TxtFilePath, EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY);
   if (EFI_ERROR(GoTimeStatus))
   {
-    Keywait(L"Kernel64.txt file is missing\r\n");
+    Print(L"Kernel64.txt file is missing\r\n");
     return GoTimeStatus;
   }
 
@@ -287,7 +270,7 @@ Txt_FileInfo->FileSize = Txt_File_Size;
       Print(L"saving files as .txt with encoding set to \"Unicode\" (Windows)\r\n");
       Print(L"or \"UTF16\" (Linux), so use one of them to make Kernel64.txt.\r\n\n");
     }
-    Keywait(L"Please fix the file and try again.\r\n");
+    Print(L"Please fix the file and try again.\r\n");
     return GoTimeStatus;
   }
   // Parse Kernel64.txt file for location of kernel image and command line
@@ -390,6 +373,20 @@ Txt_FileInfo->FileSize = Txt_File_Size;
   }
   Cmdline[CmdlineLen] = L'\0'; // Need to null-terminate this string
 
+  // Whatever follows the command line lists boot modules; keep it until the kernel is loaded (see LoadBootModules() in Module.c)
+  UINT64 ModuleListStart = FirstLineLength + CmdlineLen;
+  UINT64 ModuleListLen = (ModuleListStart < ((Txt_FileInfo->FileSize) >> 1)) ? ((Txt_FileInfo->FileSize) >> 1) - ModuleListStart : 0;
+
+  CHAR16 * ModuleList;
+  GoTimeStatus = gBS->AllocatePool(EfiBootServicesData, (ModuleListLen + 1) << 1, (void**)&ModuleList);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    Print(L"ModuleList AllocatePool error. 0x%llx\r\n", GoTimeStatus);
+    return GoTimeStatus;
+  }
+  CopyMem(ModuleList, &KernelcmdArray[ModuleListStart], ModuleListLen << 1);
+  ModuleList[ModuleListLen] = L'\0';
+
 #ifdef LOADER_DEBUG_ENABLED
   Print(L"Kernel image path: %s\r\nKernel image path size: %u\r\n", KernelPath, KernelPathSize);
   Print(L"Kernel command line: %s\r\nKernel command line size: %u\r\n", Cmdline, CmdlineSize);
@@ -418,10 +415,48 @@ Txt_FileInfo->FileSize = Txt_File_Size;
     return GoTimeStatus;
   }
 
+  BootStamp(BOOT_STAMP_CONFIG_PARSED);
+
+  // Set up graphics, now that Kernel64.txt has said which mode to use
+  BootStamp(BOOT_STAMP_GOP_START);
+  GoTimeStatus = InitUEFI_GOP(ImageHandle, Graphics, Cmdline);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    Print(L"InitUEFI_GOP error. 0x%llx\r\n", GoTimeStatus);
+    return GoTimeStatus;
+  }
+  BootStamp(BOOT_STAMP_GOP_DONE);
+
+#ifdef GOP_DEBUG_ENABLED
+  // Integrity check
+  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
+  {
+    Print(L"GPU Mode: %u of %u\r\n", Graphics->GPUArray[k].Mode, Graphics->GPUArray[k].MaxMode - 1);
+    Print(L"GPU FB: 0x%016llx\r\n", Graphics->GPUArray[k].FrameBufferBase);
+    Print(L"GPU FB Size: 0x%016llx\r\n", Graphics->GPUArray[k].FrameBufferSize);
+    Print(L"GPU SizeOfInfo: %u Bytes\r\n", Graphics->GPUArray[k].SizeOfInfo);
+    Print(L"GPU Info Ver: 0x%x\r\n", Graphics->GPUArray[k].Info->Version);
+    Print(L"GPU Info Res: %ux%u\r\n", Graphics->GPUArray[k].Info->HorizontalResolution, Graphics->GPUArray[k].Info->VerticalResolution);
+    Print(L"GPU Info PxFormat: 0x%x\r\n", Graphics->GPUArray[k].Info->PixelFormat);
+    Print(L"GPU Info PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x\r\n", Graphics->GPUArray[k].Info->PixelInformation.RedMask, Graphics->GPUArray[k].Info->PixelInformation.GreenMask, Graphics->GPUArray[k].Info->PixelInformation.BlueMask, Graphics->GPUArray[k].Info->PixelInformation.ReservedMask);
+    Print(L"GPU Info PxPerScanLine: %u\r\n", Graphics->GPUArray[k].Info->PixelsPerScanLine);
+    Keywait(L"\0");
+  }
+#endif
+
 ///
 
   EFI_FILE *KernelFile;
+  PACKED_KERNEL *PackedKernel = NULL; // Set if the kernel comes from a compressed container
 
+#ifdef PACKED_KERNEL_LOAD
+  GoTimeStatus = OpenPackedKernel(CurrentDriveRoot, KernelPath, &KernelFile, &PackedKernel);
+  if(EFI_ERROR(GoTimeStatus) && (GoTimeStatus != EFI_NOT_FOUND))
+  {
+    return GoTimeStatus;
+  }
+  if(PackedKernel == NULL)
+#endif
   // Open the kernel file from current drive root and point to it with KernelFile
 	GoTimeStatus = CurrentDriveRoot->Open(CurrentDriveRoot, &KernelFile, KernelPath, EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY);
 	if (EFI_ERROR(GoTimeStatus))
@@ -430,6 +465,8 @@ Txt_FileInfo->FileSize = Txt_File_Size;
 		return GoTimeStatus;
 	}
 
+  BootStamp(BOOT_STAMP_LOAD_START);
+
 #ifdef LOADER_DEBUG_ENABLED
   Keywait(L"Kernel file opened.\r\n");
 #endif
@@ -520,7 +557,14 @@ Txt_FileInfo->FileSize = Txt_File_Size;
     struct Elf ELF32header;
     size = sizeof(ELF32header); // This works because it's not a pointer
 
-    GoTimeStatus = KernelFile->Read(KernelFile, &size, &ELF32header);
+    if(PackedKernel)
+    {
+      GoTimeStatus = PackedKernelRead(PackedKernel, 0, &size, &ELF32header);
+    }
+    else
+    {
+      GoTimeStatus = KernelFile->Read(KernelFile, &size, &ELF32header);
+    }
     if(EFI_ERROR(GoTimeStatus))
     {
       Print(L"Header read error (ELF). 0x%llx\r\n", GoTimeStatus);
@@ -580,7 +624,14 @@ Txt_FileInfo->FileSize = Txt_File_Size;
           Print(L"Error setting file position for mapping (ELF). 0x%llx\r\n", GoTimeStatus);
           return GoTimeStatus;
         }
-        GoTimeStatus = KernelFile->Read(KernelFile, &size, &program_headers_table[0]); // Run right over the section table, it should be exactly the size to hold this data
+        if(PackedKernel)
+        {
+          GoTimeStatus = PackedKernelRead(PackedKernel, ELF32header.e_phoff, &size, &program_headers_table[0]);
+        }
+        else
+        {
+          GoTimeStatus = KernelFile->Read(KernelFile, &size, &program_headers_table[0]); // Run right over the section table, it should be exactly the size to hold this data
+        }
         if(EFI_ERROR(GoTimeStatus))
         {
           Print(L"Error reading program headers (ELF). 0x%llx\r\n", GoTimeStatus);
@@ -639,14 +690,23 @@ Txt_FileInfo->FileSize = Txt_File_Size;
         Keywait(L"Zeroing\r\n");
 #endif
 
+#ifdef LOAD_TIME_INFO
+        TscTicksPerMs(); // Calibrate now so the Stall() doesn't land inside the timed region
+        UINT64 LoadStart = AsmReadTsc();
+        UINT64 ZeroTicks = 0;
+#endif
+        UINT64 BssBytes = 0;
+
+#ifndef MEMORY_CHECK_DISABLED
         // Zero the allocated pages
+        // Only the buggy firmware check below needs this: otherwise every byte of a PT_LOAD segment is
+        // either read from the file or is BSS and gets zeroed in the segment loop.
         ZeroMem((UINT8*)(uintptr_t)AllocatedMemory, (pages << EFI_PAGE_SHIFT));
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
+  #ifdef ELF_LOADER_DEBUG_ENABLED
         Keywait(L"MemZeroed\r\n");
-#endif
+  #endif
 
-#ifndef MEMORY_CHECK_DISABLED
         // If that memory isn't actually free due to weird firmware behavior...
         // Iterate through the entirety of what was just allocated and check to make sure it's all zeros
         // Start buggy firmware workaround
@@ -686,54 +746,45 @@ Txt_FileInfo->FileSize = Txt_File_Size;
               return GoTimeStatus;
             }
 
-            // NOTE: CANNOT create an array of all compatible free addresses because the array takes up memory. So does the memory map.
-            // This results in a paradox, so we need to scan the memory map every time we need to find a new address...
+            // NOTE: The free ranges are snapshotted from the memory map once per search and walked in address order. The map is only
+            // read again when the firmware refuses a candidate (see AllocateNextFreeRange() in Memory.c), instead of for every address.
 
             // It appears that AllocateAnyPages uses a "MaxAddress" approach. This will go bottom-up instead.
             EFI_PHYSICAL_ADDRESS NewAddress = 0; // Start at zero
             EFI_PHYSICAL_ADDRESS OldAllocatedMemory = AllocatedMemory;
+            FREE_RANGE_ITER FreeRanges;
 
-            GoTimeStatus = gBS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress); // Need to check 0x0
-            while(GoTimeStatus != EFI_SUCCESS)
-            { // Keep checking free memory addresses until one works
+            GoTimeStatus = FreeRangeIterInit(&FreeRanges, pages, FALSE);
+            if(EFI_ERROR(GoTimeStatus))
+            {
+              Print(L"Could not snapshot free memory for ELF pages. Error code: 0x%llx\r\n", GoTimeStatus);
+              return GoTimeStatus;
+            }
 
+            GoTimeStatus = gBS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress); // Need to check 0x0
+            if(GoTimeStatus == EFI_NOT_FOUND)
+            {
+              // 0's not a good address (not enough contiguous pages could be found), get another one
+              // Address can be > 4GB
+              GoTimeStatus = AllocateNextFreeRange(&FreeRanges, EfiLoaderData, OldAllocatedMemory, &NewAddress);
               if(GoTimeStatus == EFI_NOT_FOUND)
-              {
-                // 0's not a good address (not enough contiguous pages could be found), get another one
-                NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                // Make sure the new address isn't the known bad one
-                if(NewAddress == OldAllocatedMemory)
-                {
-                  // Get a new address if it is
-                  NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                }
-                // Address can be > 4GB
-              }
-              else if(EFI_ERROR(GoTimeStatus))
-              {
-                Print(L"Could not get an address for ELF pages. Error code: 0x%llx\r\n", GoTimeStatus);
-                return GoTimeStatus;
-              }
-
-              if(NewAddress == ~0ULL)
               {
                 // If you get this, you had no memory free anywhere.
                 Print(L"No memory marked as EfiConventionalMemory...\r\n");
                 return GoTimeStatus;
               }
-
-              // Allocate the new address
-              GoTimeStatus = gBS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-              // This loop shouldn't run more than once, but in the event something is at 0x0 we need to
-              // leave the loop with an allocated address
-
+            }
+            if(EFI_ERROR(GoTimeStatus))
+            {
+              Print(L"Could not get an address for ELF pages. Error code: 0x%llx\r\n", GoTimeStatus);
+              return GoTimeStatus;
             }
 
             // Got a new address that's been allocated--save it
             AllocatedMemory = NewAddress;
 
             // Verify it's empty
-            while((NewAddress != ~0ULL) && VerifyZeroMem(pages << EFI_PAGE_SHIFT, AllocatedMemory)) // Loop this in case the firmware is really screwed
+            while((AllocatedMemory != ~0ULL) && VerifyZeroMem(pages << EFI_PAGE_SHIFT, AllocatedMemory)) // Loop this in case the firmware is really screwed
             { // It's not empty :(
 
               // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
@@ -761,42 +812,24 @@ Txt_FileInfo->FileSize = Txt_File_Size;
                   return GoTimeStatus;
                 }
 
-                // Allocate a new address
-                GoTimeStatus = EFI_NOT_FOUND;
-                while((GoTimeStatus != EFI_SUCCESS) && (NewAddress != ~0ULL))
+                // Allocate a new address (ideally, this should be very rare)
+                GoTimeStatus = AllocateNextFreeRange(&FreeRanges, EfiLoaderData, OldAllocatedMemory, &NewAddress);
+                if(EFI_ERROR(GoTimeStatus) && (GoTimeStatus != EFI_NOT_FOUND))
                 {
-                  if(GoTimeStatus == EFI_NOT_FOUND)
-                  {
-                    // Get an address (ideally, this should be very rare)
-                    NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                    // Make sure the new address isn't the known bad one
-                    if(NewAddress == OldAllocatedMemory)
-                    {
-                      // Get a new address if it is
-                      NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                    }
-                    // Address can be > 4GB
-                    // This loop will run until we get a good address (shouldn't be more than once, if ever)
-                  }
-                  else if(EFI_ERROR(GoTimeStatus))
-                  {
-                    // EFI_OUT_OF_RESOURCES means the firmware's just not gonna load anything.
-                    Print(L"Could not get an address for ELF pages (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                    return GoTimeStatus;
-                  }
-                  // NOTE: The number of times the message "No more free addresses" pops up
-                  // helps indicate which NewAddress assignment hit the end.
-
-                  GoTimeStatus = gBS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-                } // loop
+                  // EFI_OUT_OF_RESOURCES means the firmware's just not gonna load anything.
+                  Print(L"Could not get an address for ELF pages (loop). Error code: 0x%llx\r\n", GoTimeStatus);
+                  return GoTimeStatus;
+                }
 
-                // It's a new address
+                // It's a new address (~0ULL if we ran out)
                 AllocatedMemory = NewAddress;
 
                 // Verify new address is empty (in loop), if not then free it and try again.
               } // else
             } // End VerifyZeroMem while loop
 
+            FreeRangeIterFree(&FreeRanges);
+
             // Ran out of easy addresses, time for a more thorough check
             // Hopefully no one ever gets here
             if(AllocatedMemory == ~0ULL)
@@ -816,37 +849,26 @@ Txt_FileInfo->FileSize = Txt_File_Size;
               Keywait(L"About to search page by page\r\n");
     #endif
 
-              NewAddress = ActuallyFreeAddress(pages, 0); // Start from the first suitable EfiConventionalMemory address.
-              // Allocate the page's address
-              GoTimeStatus = EFI_NOT_FOUND;
-              while(GoTimeStatus != EFI_SUCCESS)
+              // Start from the first suitable EfiConventionalMemory address
+              GoTimeStatus = FreeRangeIterInit(&FreeRanges, pages, TRUE);
+              if(EFI_ERROR(GoTimeStatus))
               {
-                if(GoTimeStatus == EFI_NOT_FOUND)
-                {
-                  // Nope, get another one
-                  NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                  // Make sure the new address isn't the known bad one
-                  if(NewAddress == OldAllocatedMemory)
-                  {
-                    // Get a new address if it is
-                    NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                  }
-                  // Adresses very well might be > 4GB with the filesizes these are allowed to be
-                }
-                else if(EFI_ERROR(GoTimeStatus))
-                {
-                  Print(L"Could not get an address for ELF pages by page. Error code: 0x%llx\r\n", GoTimeStatus);
-                  return GoTimeStatus;
-                }
-
-                if(NewAddress == ~0ULL)
-                {
-                  // If you somehow get this, you really had no memory free anywhere.
-                  Print(L"Hmm... How did you get here?\r\n");
-                  return GoTimeStatus;
-                }
+                Print(L"Could not snapshot free memory for ELF pages by page. Error code: 0x%llx\r\n", GoTimeStatus);
+                return GoTimeStatus;
+              }
 
-                GoTimeStatus = gBS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
+              // Adresses very well might be > 4GB with the filesizes these are allowed to be
+              GoTimeStatus = AllocateNextFreeRange(&FreeRanges, EfiLoaderData, OldAllocatedMemory, &NewAddress);
+              if(GoTimeStatus == EFI_NOT_FOUND)
+              {
+                // If you somehow get this, you really had no memory free anywhere.
+                Print(L"Hmm... How did you get here?\r\n");
+                return GoTimeStatus;
+              }
+              else if(EFI_ERROR(GoTimeStatus))
+              {
+                Print(L"Could not get an address for ELF pages by page. Error code: 0x%llx\r\n", GoTimeStatus);
+                return GoTimeStatus;
               }
 
               AllocatedMemory = NewAddress;
@@ -878,40 +900,21 @@ Txt_FileInfo->FileSize = Txt_File_Size;
                     return GoTimeStatus;
                   }
 
-                  GoTimeStatus = EFI_NOT_FOUND;
-                  while(GoTimeStatus != EFI_SUCCESS)
+                  // Nope, get another one
+                  GoTimeStatus = AllocateNextFreeRange(&FreeRanges, EfiLoaderData, OldAllocatedMemory, &NewAddress);
+                  if(EFI_ERROR(GoTimeStatus))
                   {
-                    if(GoTimeStatus == EFI_NOT_FOUND)
-                    {
-                      // Nope, get another one
-                      NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                      // Make sure the new address isn't the known bad one
-                      if(NewAddress == OldAllocatedMemory)
-                      {
-                        // Get a new address if it is
-                        NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                      }
-                      // Address can be > 4GB
-                    }
-                    else if(EFI_ERROR(GoTimeStatus))
-                    {
-                      Print(L"Could not get an address for ELF pages by page (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                      return GoTimeStatus;
-                    }
-
-                    if(AllocatedMemory == ~0ULL)
-                    {
-                      // Well, darn. Something's up with the system memory.
-                      return GoTimeStatus;
-                    }
-
-                    GoTimeStatus = gBS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-                  } // loop
+                    // Well, darn. Something's up with the system memory.
+                    Print(L"Could not get an address for ELF pages by page (loop). Error code: 0x%llx\r\n", GoTimeStatus);
+                    return GoTimeStatus;
+                  }
 
                   AllocatedMemory = NewAddress;
 
                 } // else
               } // end ByPage VerifyZeroMem loop
+
+              FreeRangeIterFree(&FreeRanges);
   #endif
             } // End "big guns"
 
@@ -931,6 +934,9 @@ Txt_FileInfo->FileSize = Txt_File_Size;
           Print(L"Allocated memory was zeroed OK\r\n");
   #endif
         }
+  #ifdef LOAD_TIME_INFO
+        ZeroTicks = AsmReadTsc() - LoadStart;
+  #endif
 #endif
 
 #ifdef ELF_LOADER_DEBUG_ENABLED
@@ -939,6 +945,25 @@ Txt_FileInfo->FileSize = Txt_File_Size;
 #endif
 
         // No need to copy headers to memory for ELFs, just the program itself
+        if(PackedKernel)
+        {
+          GoTimeStatus = UnpackSegments(PackedKernel);
+          if(EFI_ERROR(GoTimeStatus))
+          {
+            return GoTimeStatus;
+          }
+        }
+#ifdef STREAMING_ELF_LOAD
+        else
+        {
+          GoTimeStatus = StreamLoadSegments(KernelFile, program_headers_table, Numofprogheaders);
+          if(EFI_ERROR(GoTimeStatus))
+          {
+            return GoTimeStatus;
+          }
+        }
+#endif
+
         // Only want to include PT_LOAD segments
         for(i = 0; i < Numofprogheaders; i++) // Load sections into memory
         {
@@ -950,17 +975,18 @@ Txt_FileInfo->FileSize = Txt_File_Size;
           Print(L"\n%llu. current section address: 0x%x, RawDataSize: 0x%llx\r\n", i+1, specific_program_header->p_va, RawDataSize);
 #endif
 
-          if(1)
+          if(specific_program_header->p_type == ELF_PROG_LOAD)
           {
 
 #ifdef ELF_LOADER_DEBUG_ENABLED
             Print(L"current destination address: 0x%llx, AllocatedMemory base: 0x%llx\r\n", SectionAddress, AllocatedMemory);
             Print(L"PointerToRawData: 0x%llx\r\n", specific_program_header->p_offset);
-            Print(L"Check:\r\nSectionAddress: 0x%llx\r\nData there: 0x%016llx%016llx (should be 0)\r\n", SectionAddress, *(EFI_PHYSICAL_ADDRESS*)(uintptr_t)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS *)(uintptr_t)SectionAddress); // print the first 128 bits of that address to compare
+            Print(L"Check:\r\nSectionAddress: 0x%llx\r\nData there: 0x%016llx%016llx (should be 0 unless streamed)\r\n", SectionAddress, *(EFI_PHYSICAL_ADDRESS*)(uintptr_t)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS *)(uintptr_t)SectionAddress); // print the first 128 bits of that address to compare
             Print(L"About to load section %llu of %llu...\r\n", i + 1, Numofprogheaders);
             Keywait(L"\0");
 #endif
 
+#ifndef STREAMING_ELF_LOAD
             GoTimeStatus = KernelFile->SetPosition(KernelFile, specific_program_header->p_offset); // p_offset is a UINT64 relative to the beginning of the file, just like Read() expects!
             if(EFI_ERROR(GoTimeStatus))
             {
@@ -968,7 +994,7 @@ Txt_FileInfo->FileSize = Txt_File_Size;
               return GoTimeStatus;
             }
 
-            if(RawDataSize != 0) // Apparently some UEFI implementations can't deal with reading 0 byte sections
+            if((RawDataSize != 0) && (PackedKernel == NULL)) // Apparently some UEFI implementations can't deal with reading 0 byte sections
             {
               GoTimeStatus = KernelFile->Read(KernelFile, &RawDataSize, (VOID*)(uintptr_t)SectionAddress); // (void*)SectionAddress
               if(EFI_ERROR(GoTimeStatus))
@@ -977,6 +1003,20 @@ Txt_FileInfo->FileSize = Txt_File_Size;
                 return GoTimeStatus;
               }
             }
+#endif
+
+            // Zero the BSS tail, [p_pa + p_filesz, p_pa + p_memsz)
+            if(specific_program_header->p_memsz > specific_program_header->p_filesz)
+            {
+#if defined(LOAD_TIME_INFO) && defined(MEMORY_CHECK_DISABLED)
+              UINT64 ZeroStart = AsmReadTsc();
+#endif
+              ZeroMem((VOID*)(uintptr_t)(SectionAddress + specific_program_header->p_filesz), specific_program_header->p_memsz - specific_program_header->p_filesz);
+              BssBytes += specific_program_header->p_memsz - specific_program_header->p_filesz;
+#if defined(LOAD_TIME_INFO) && defined(MEMORY_CHECK_DISABLED)
+              ZeroTicks += AsmReadTsc() - ZeroStart;
+#endif
+            }
 #ifdef ELF_LOADER_DEBUG_ENABLED
             Print(L"\r\nVerify:\r\nSectionAddress: 0x%llx\r\nData there (first 16 bytes): 0x%016llx%016llx\r\n", SectionAddress, *(EFI_PHYSICAL_ADDRESS*)(uintptr_t)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS*)(uintptr_t)SectionAddress); // print the first 128 bits of that address to compare
             Print(L"Last 16 bytes: 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(uintptr_t)(SectionAddress + RawDataSize - 8), *(EFI_PHYSICAL_ADDRESS*)(uintptr_t)(SectionAddress + RawDataSize - 16));
@@ -993,6 +1033,19 @@ Txt_FileInfo->FileSize = Txt_File_Size;
           }
         }
 
+#ifdef LOAD_TIME_INFO
+        UINT64 LoadTicks = AsmReadTsc() - LoadStart;
+  #ifdef MEMORY_CHECK_DISABLED
+        // What zeroing the rest of the allocation would have cost, at the rate the BSS tails were zeroed
+        // (VerifyZeroMem() reading it all back again came on top of that)
+        UINT64 SkippedBytes = (pages << EFI_PAGE_SHIFT) - BssBytes;
+        UINT64 SavedTicks = BssBytes ? DivU64x64Remainder(MultU64x64(ZeroTicks, SkippedBytes), BssBytes, NULL) : 0;
+        Print(L"Kernel loaded in %llu ms: zeroed %llu BSS bytes, skipped %llu bytes (~%llu ms saved)\r\n", TscToMs(LoadTicks), BssBytes, SkippedBytes, TscToMs(SavedTicks));
+  #else
+        Print(L"Kernel loaded in %llu ms, %llu ms of it zeroing and verifying %llu bytes\r\n", TscToMs(LoadTicks), TscToMs(ZeroTicks), pages << EFI_PAGE_SHIFT);
+  #endif
+#endif
+
         // Done with program_headers_table
         if(program_headers_table)
         {
@@ -1038,6 +1091,20 @@ Txt_FileInfo->FileSize = Txt_File_Size;
     }
   }
 
+  // Boot modules go after the kernel so they can't take the addresses its segments want
+  BOOT_MODULE * Modules;
+  UINTN NumModules;
+
+  GoTimeStatus = LoadBootModules(CurrentDriveRoot, ModuleList, &Modules, &NumModules);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    Print(L"LoadBootModules error. 0x%llx\r\n", GoTimeStatus);
+    return GoTimeStatus;
+  }
+  gBS->FreePool(ModuleList);
+
+  BootStamp(BOOT_STAMP_LOAD_DONE);
+
 #ifdef FINAL_LOADER_DEBUG_ENABLED
   Print(L"Header_memory: 0x%llx\r\n", Header_memory);
   Print(L"Data at Header_memory (first 16 bytes): 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(uintptr_t)(Header_memory + 8), *(EFI_PHYSICAL_ADDRESS*)(uintptr_t)Header_memory);
@@ -1155,6 +1222,37 @@ Txt_FileInfo->FileSize = Txt_File_Size;
 
 // Below is a better, but more complex version. EFI Spec recommends this method; apparently some systems need a second call to ExitBootServices.
 
+  BootStamp(BOOT_STAMP_EXIT_BOOT);
+
+  // Reserve room for the coalesced memory map now, since nothing can be allocated once boot services are gone. Merging never adds
+  // ranges, so the firmware map's descriptor count plus a little slack for the allocations from here on is always enough.
+  MEMORY_RANGE * MemRanges = NULL;
+  UINTN MemRangesMax = 0;
+
+  GoTimeStatus = gBS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+  if(GoTimeStatus == EFI_BUFFER_TOO_SMALL)
+  {
+    MemRangesMax = MemMapSize / MemMapDescriptorSize + MEMORY_RANGE_SLACK;
+    GoTimeStatus = gBS->AllocatePool(EfiLoaderData, MemRangesMax * sizeof(MEMORY_RANGE), (void **)&MemRanges);
+    if(EFI_ERROR(GoTimeStatus))
+    {
+      Print(L"MemRanges AllocatePool error. 0x%llx\r\n", GoTimeStatus);
+      return GoTimeStatus;
+    }
+  }
+  MemMapSize = 0;
+
+  // One page below 4 GB for the kernel's initial page directory, also filled in after ExitBootServices(). Paging is optional for the
+  // kernel, so failing to get it isn't fatal.
+  EFI_PHYSICAL_ADDRESS PageDirectory = 0xFFFFFFFF;
+
+  GoTimeStatus = gBS->AllocatePages(AllocateMaxAddress, EfiLoaderData, 1, &PageDirectory);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    Print(L"PageDirectory AllocatePages error, continuing without it. 0x%llx\r\n", GoTimeStatus);
+    PageDirectory = 0;
+  }
+
   // Get memory map and exit boot services
   GoTimeStatus = gBS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
   if(GoTimeStatus == EFI_BUFFER_TOO_SMALL)
@@ -1269,6 +1367,16 @@ Txt_FileInfo->FileSize = Txt_File_Size;
 
     EFI_CONFIGURATION_TABLE  *ConfigTables;                   // UEFI-installed system configuration tables (ACPI, SMBIOS, etc.)
     UINTN                     Number_of_ConfigTables;         // The number of system configuration tables
+
+    BOOT_TIMING               Boot_Timing;                    // TSC stamps of each boot phase so far
+
+    MEMORY_RANGE             *Memory_Ranges;                  // The memory map sorted by address with same-type neighbours merged
+    UINTN                     Number_of_Memory_Ranges;        // The number of entries in it
+
+    EFI_PHYSICAL_ADDRESS      Page_Directory;                 // Initial 4 MiB-page directory for CR3, or 0
+
+    BOOT_MODULE              *Modules;                        // Files listed after the command line in Kernel64.txt
+    UINTN                     Number_of_Modules;              // The number of entries in it
   } LOADER_PARAMS;
 */
 
@@ -1299,6 +1407,23 @@ Txt_FileInfo->FileSize = Txt_File_Size;
   Loader_block->ConfigTables = SysCfgTables;
   Loader_block->Number_of_ConfigTables = NumSysCfgTables;
 
+  Loader_block->Memory_Ranges = MemRanges;
+  Loader_block->Number_of_Memory_Ranges = CoalesceMemoryMap(MemMap, MemMapSize, MemMapDescriptorSize, MemRanges, MemRangesMax);
+
+  Loader_block->Modules = Modules;
+  Loader_block->Number_of_Modules = NumModules;
+
+  // The page directory is built from the coalesced map, so without one the kernel has to make do without it
+  Loader_block->Page_Directory = 0;
+  if(PageDirectory && Loader_block->Number_of_Memory_Ranges)
+  {
+    BuildPageDirectory((UINT32*)(UINTN)PageDirectory, MemRanges, Loader_block->Number_of_Memory_Ranges, Graphics);
+    Loader_block->Page_Directory = PageDirectory;
+  }
+
+  BootStamp(BOOT_STAMP_KERNEL_JUMP);
+  BootTimingSave(&Loader_block->Boot_Timing);
+
   // Jump to entry point, and WE ARE LIVE!!
 //  ((EFIAPI void(*)(void)) (uintptr_t)Header_memory)(); //TODO remove
 
@@ -0,0 +1,256 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Compressed Kernel Loader
+//==================================================================================================================================
+//
+// This file contains the loader for compressed kernel containers, which kern/mklz4.pl builds from the kernel ELF. A container is
+// read with one Read() and then each PT_LOAD segment is decompressed straight into place, trading most of the file I/O for a fast
+// LZ4 decode. See PACKED_KERNEL_HEADER in Bootloader.h for the layout.
+//
+
+#include "Bootloader.h"
+
+#define LZ4_ERROR ((UINTN)-1)
+
+//==================================================================================================================================
+//  Lz4DecodeBlock: LZ4 Block Decoder
+//==================================================================================================================================
+//
+// Decode one raw LZ4 block (no frame header) of SrcSize bytes into Dst. Returns the number of bytes produced, or LZ4_ERROR if the
+// block is malformed or would overrun DstSize bytes.
+//
+
+STATIC UINTN Lz4DecodeBlock(CONST UINT8 *Src, UINTN SrcSize, UINT8 *Dst, UINTN DstSize)
+{
+  CONST UINT8 *SrcEnd = Src + SrcSize;
+  UINT8 *Out = Dst;
+  UINT8 *DstEnd = Dst + DstSize;
+  UINTN Token, Length, Offset;
+  UINT8 Byte;
+
+  while(Src < SrcEnd)
+  {
+    Token = *Src++;
+
+    // Literals
+    Length = Token >> 4;
+    if(Length == 15)
+    {
+      do
+      {
+        if(Src >= SrcEnd)
+        {
+          return LZ4_ERROR;
+        }
+        Byte = *Src++;
+        Length += Byte;
+      } while(Byte == 255);
+    }
+    if((Length > (UINTN)(SrcEnd - Src)) || (Length > (UINTN)(DstEnd - Out)))
+    {
+      return LZ4_ERROR;
+    }
+    CopyMem(Out, Src, Length);
+    Out += Length;
+    Src += Length;
+
+    if(Src == SrcEnd) // The last sequence has no match
+    {
+      break;
+    }
+
+    // Match
+    if(SrcEnd - Src < 2)
+    {
+      return LZ4_ERROR;
+    }
+    Offset = Src[0] | (Src[1] << 8);
+    Src += 2;
+    if((Offset == 0) || (Offset > (UINTN)(Out - Dst)))
+    {
+      return LZ4_ERROR;
+    }
+
+    Length = Token & 15;
+    if(Length == 15)
+    {
+      do
+      {
+        if(Src >= SrcEnd)
+        {
+          return LZ4_ERROR;
+        }
+        Byte = *Src++;
+        Length += Byte;
+      } while(Byte == 255);
+    }
+    Length += 4;
+    if(Length > (UINTN)(DstEnd - Out))
+    {
+      return LZ4_ERROR;
+    }
+
+    if(Offset >= Length) // No overlap
+    {
+      CopyMem(Out, Out - Offset, Length);
+    }
+    else if(Offset == 1) // A run of one byte, which is what zero padding turns into
+    {
+      SetMem(Out, Length, Out[-1]);
+    }
+    else // Overlapping copies repeat the pattern, so go forwards a byte at a time
+    {
+      for(UINTN i = 0; i < Length; i++)
+      {
+        Out[i] = Out[i - Offset];
+      }
+    }
+    Out += Length;
+  }
+
+  return (UINTN)(Out - Dst);
+}
+
+//==================================================================================================================================
+//  OpenPackedKernel: Open And Read A Compressed Kernel Container
+//==================================================================================================================================
+//
+// Look for KernelPath with ".lz4" appended. If it's there, open it as *KernelFile, read it whole into a pool and check its header.
+// Returns EFI_NOT_FOUND (and leaves *Packed NULL) if there is no container, so the caller can fall back to the plain ELF.
+//
+
+EFI_STATUS OpenPackedKernel(EFI_FILE *Root, CHAR16 *KernelPath, EFI_FILE **KernelFile, PACKED_KERNEL **Packed)
+{
+  EFI_STATUS Status;
+  CHAR16 *PackedPath;
+  UINTN PathSize = StrSize(KernelPath) + sizeof(PACKED_KERNEL_SUFFIX) - sizeof(CHAR16);
+  EFI_FILE_INFO *Info;
+  PACKED_KERNEL *Kernel;
+  UINTN Size;
+
+  *Packed = NULL;
+
+  Status = gBS->AllocatePool(EfiBootServicesData, PathSize, (void**)&PackedPath);
+  if(EFI_ERROR(Status))
+  {
+    Print(L"PackedPath AllocatePool error. 0x%llx\r\n", Status);
+    return Status;
+  }
+  StrCpyS(PackedPath, PathSize / sizeof(CHAR16), KernelPath);
+  StrCatS(PackedPath, PathSize / sizeof(CHAR16), PACKED_KERNEL_SUFFIX);
+
+  Status = Root->Open(Root, KernelFile, PackedPath, EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY);
+  gBS->FreePool(PackedPath);
+  if(EFI_ERROR(Status))
+  {
+    return EFI_NOT_FOUND;
+  }
+
+  // GetInfo will intentionally error out and provide the correct info size
+  Size = 0;
+  (*KernelFile)->GetInfo(*KernelFile, &gEfiFileInfoGuid, &Size, NULL);
+  Status = gBS->AllocatePool(EfiBootServicesData, Size, (void**)&Info);
+  if(EFI_ERROR(Status))
+  {
+    Print(L"Packed kernel FileInfo AllocatePool error. 0x%llx\r\n", Status);
+    return Status;
+  }
+  Status = (*KernelFile)->GetInfo(*KernelFile, &gEfiFileInfoGuid, &Size, Info);
+  if(EFI_ERROR(Status))
+  {
+    Print(L"Packed kernel GetInfo error. 0x%llx\r\n", Status);
+    return Status;
+  }
+  Size = (UINTN)Info->FileSize;
+  gBS->FreePool(Info);
+
+  Status = gBS->AllocatePool(EfiBootServicesData, sizeof(PACKED_KERNEL) + Size, (void**)&Kernel);
+  if(EFI_ERROR(Status))
+  {
+    Print(L"Packed kernel AllocatePool error. 0x%llx\r\n", Status);
+    return Status;
+  }
+  Kernel->FileSize = Size;
+  Kernel->Header = (PACKED_KERNEL_HEADER*)(Kernel + 1);
+
+  Status = (*KernelFile)->Read(*KernelFile, &Size, Kernel->Header);
+  if(EFI_ERROR(Status))
+  {
+    Print(L"Packed kernel read error. 0x%llx\r\n", Status);
+    return Status;
+  }
+
+  if((Size < sizeof(PACKED_KERNEL_HEADER)) || (Kernel->Header->Magic != PACKED_KERNEL_MAGIC) || (Kernel->Header->Version != PACKED_KERNEL_VERSION) ||
+     (Size < sizeof(PACKED_KERNEL_HEADER) + Kernel->Header->PrefixSize + Kernel->Header->NumBlocks * sizeof(PACKED_KERNEL_BLOCK)))
+  {
+    Print(L"%s%s is not a valid compressed kernel.\r\n", KernelPath, PACKED_KERNEL_SUFFIX);
+    return EFI_LOAD_ERROR;
+  }
+
+  Kernel->Prefix = (UINT8*)(Kernel->Header + 1);
+  Kernel->Blocks = (PACKED_KERNEL_BLOCK*)(Kernel->Prefix + Kernel->Header->PrefixSize);
+  *Packed = Kernel;
+
+#ifdef LOADER_DEBUG_ENABLED
+  Print(L"Compressed kernel %s%s: %llu bytes, %u blocks\r\n", KernelPath, PACKED_KERNEL_SUFFIX, (UINT64)Kernel->FileSize, Kernel->Header->NumBlocks);
+#endif
+
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  PackedKernelRead: Read From The Uncompressed Part Of A Container
+//==================================================================================================================================
+//
+// Stands in for SetPosition() + Read() on the kernel ELF for the ELF and program headers, which the container stores verbatim.
+//
+
+EFI_STATUS PackedKernelRead(PACKED_KERNEL *Packed, UINT64 Offset, UINTN *Size, VOID *Buffer)
+{
+  if((Offset > Packed->Header->PrefixSize) || (*Size > Packed->Header->PrefixSize - Offset))
+  {
+    Print(L"Compressed kernel has no ELF data at 0x%llx (+0x%llx).\r\n", Offset, (UINT64)*Size);
+    return EFI_END_OF_FILE;
+  }
+
+  CopyMem(Buffer, Packed->Prefix + Offset, *Size);
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  UnpackSegments: Decompress Every Segment Into Place
+//==================================================================================================================================
+//
+// Each block decodes straight to its p_pa. BSS tails are left to the caller, as with the uncompressed loaders.
+//
+
+EFI_STATUS UnpackSegments(PACKED_KERNEL *Packed)
+{
+  CONST UINT8 *Data = (CONST UINT8*)(Packed->Blocks + Packed->Header->NumBlocks);
+  CONST UINT8 *DataEnd = (CONST UINT8*)Packed->Header + Packed->FileSize;
+#ifdef LOAD_TIME_INFO
+  UINT64 Unpacked = 0;
+  UINT64 Start = AsmReadTsc();
+#endif
+
+  for(UINT32 i = 0; i < Packed->Header->NumBlocks; i++)
+  {
+    PACKED_KERNEL_BLOCK *Block = &Packed->Blocks[i];
+
+    if((Block->PackedSize > (UINTN)(DataEnd - Data)) ||
+       (Lz4DecodeBlock(Data, Block->PackedSize, (UINT8*)(uintptr_t)Block->Pa, Block->RawSize) != Block->RawSize))
+    {
+      Print(L"Compressed kernel block %u (0x%x bytes at 0x%x) is corrupt.\r\n", i, Block->RawSize, Block->Pa);
+      return EFI_LOAD_ERROR;
+    }
+    Data += Block->PackedSize;
+#ifdef LOAD_TIME_INFO
+    Unpacked += Block->RawSize;
+#endif
+  }
+
+#ifdef LOAD_TIME_INFO
+  Print(L"Compressed kernel: %llu bytes read (ELF %u bytes), %llu bytes decompressed in %llu us\r\n", (UINT64)Packed->FileSize, Packed->Header->ElfSize, Unpacked, TscToUs(AsmReadTsc() - Start));
+#endif
+
+  return EFI_SUCCESS;
+}
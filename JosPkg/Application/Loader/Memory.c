@@ -16,187 +16,513 @@
 #include "Bootloader.h"
 
 //==================================================================================================================================
-//  compare: Memory Comparison
+//  FirstMismatch: Memory Comparison, Word at a Time
 //==================================================================================================================================
 //
-// A simple memory comparison function.
-// Returns 1 if the two items are the same; 0 if they're not.
+// Returns the offset of the first byte that differs between the two items, or 'comparelength' if they're the same.
+//
+// Bytes are compared until 'firstitem' is UINTN-aligned, then whole words (16 bytes at a time with SSE2 on x64, where it is
+// architectural and UEFI has it enabled), then the remaining tail bytes. 'seconditem' may stay unaligned; x86 doesn't mind.
+// A differing word just drops out to the narrower loops, which pin down the exact byte.
 //
 
 // Variable 'comparelength' is in bytes
-UINT8 compare(const void* firstitem, const void* seconditem, UINT64 comparelength)
+UINT64 FirstMismatch(const void* firstitem, const void* seconditem, UINT64 comparelength)
 {
-  // Using const since this is a read-only operation: absolutely nothing should be changed here.
   const UINT8 *one = firstitem, *two = seconditem;
-  for (UINT64 i = 0; i < comparelength; i++)
+  UINT64 i = 0;
+
+  for(; (i < comparelength) && (((uintptr_t)(one + i)) & (sizeof(UINTN) - 1)); i++)
   {
     if(one[i] != two[i])
     {
-      return 0;
+      return i;
     }
   }
-  return 1;
-}
 
+#if defined(MDE_CPU_X64) && defined(__GNUC__)
+  for(; i + 16 <= comparelength; i += 16)
+  {
+    UINT32 EqualMask;
+
+    __asm__ __volatile__("movdqu (%1), %%xmm0\n\t"
+                         "movdqu (%2), %%xmm1\n\t"
+                         "pcmpeqb %%xmm1, %%xmm0\n\t"
+                         "pmovmskb %%xmm0, %0"
+                         : "=r" (EqualMask) : "r" (one + i), "r" (two + i) : "xmm0", "xmm1", "memory");
+    if(EqualMask != 0xFFFF)
+    {
+      break;
+    }
+  }
+#endif
+
+  for(; i + sizeof(UINTN) <= comparelength; i += sizeof(UINTN))
+  {
+    if(*(const UINTN*)(one + i) != *(const UINTN*)(two + i))
+    {
+      break;
+    }
+  }
+
+  for(; i < comparelength; i++)
+  {
+    if(one[i] != two[i])
+    {
+      return i;
+    }
+  }
+  return comparelength;
+}
 
 //==================================================================================================================================
-//  VerifyZeroMem: Verify Memory Is Free
+//  compare: Memory Comparison
 //==================================================================================================================================
 //
-// Return 0 if desired section of memory is zeroed (for use in "if" statements)
+// A simple memory comparison function.
+// Returns 1 if the two items are the same; 0 if they're not.
 //
 
-UINT8 VerifyZeroMem(UINT64 NumBytes, UINT64 BaseAddr) // BaseAddr is a 64-bit unsigned int whose value is the memory address
+// Variable 'comparelength' is in bytes
+UINT8 compare(const void* firstitem, const void* seconditem, UINT64 comparelength)
 {
-  for(UINT64 i = 0; i < NumBytes; i++)
+#ifdef MEMORY_TIMING_DEBUG_ENABLED
+  UINT64 Start = AsmReadTsc();
+#endif
+
+  UINT64 Offset = FirstMismatch(firstitem, seconditem, comparelength);
+
+#ifdef MEMORY_TIMING_DEBUG_ENABLED
+  if(comparelength >= EFI_PAGE_SIZE) // Skip the GUID and magic number compares
   {
-    if(*(((UINT8*)(uintptr_t)BaseAddr) + i) != 0)
-    {
-      return 1;
-    }
+    Print(L"compare: %llu bytes in %llu us, first mismatch at offset 0x%llx\r\n", comparelength, TscToUs(AsmReadTsc() - Start), Offset);
   }
-  return 0;
+#endif
+
+  return (Offset == comparelength);
 }
 
+
 //==================================================================================================================================
-//  ActuallyFreeAddress: Find A Free Memory Address, Bottom-Up
+//  FirstNonZero: Find Non-Zero Memory, Word at a Time
 //==================================================================================================================================
 //
-// This is meant to work in the event that AllocateAnyPages fails, but could have other uses. Returns the next EfiConventionalMemory
-// area that is > the supplied OldAddress.
+// Returns the offset of the first non-zero byte in the section of memory, or 'NumBytes' if it's all zeros.
+// Same head/body/tail split as FirstMismatch().
 //
 
-EFI_PHYSICAL_ADDRESS ActuallyFreeAddress(UINT64 pages, EFI_PHYSICAL_ADDRESS OldAddress)
+UINT64 FirstNonZero(UINT64 NumBytes, UINT64 BaseAddr)
 {
-  EFI_STATUS memmap_status;
-  UINTN MemMapSize = 0, MemMapKey, MemMapDescriptorSize;
-  UINT32 MemMapDescriptorVersion;
-  EFI_MEMORY_DESCRIPTOR * MemMap = NULL;
-  EFI_MEMORY_DESCRIPTOR * Piece;
+  const UINT8 *Mem = (const UINT8*)(uintptr_t)BaseAddr;
+  UINT64 i = 0;
 
-  memmap_status = gBS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
-  if(memmap_status == EFI_BUFFER_TOO_SMALL)
+  for(; (i < NumBytes) && (((uintptr_t)(Mem + i)) & (sizeof(UINTN) - 1)); i++)
   {
-    memmap_status = gBS->AllocatePool(EfiBootServicesData, MemMapSize, (void **)&MemMap); // Allocate pool for MemMap
-    if(EFI_ERROR(memmap_status)) // Error! Wouldn't be safe to continue.
+    if(Mem[i] != 0)
     {
-      Print(L"ActuallyFreeAddress MemMap AllocatePool error. 0x%llx\r\n", memmap_status);
-      return ~0ULL;
+      return i;
     }
-    memmap_status = gBS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
-  }
-  if(EFI_ERROR(memmap_status))
-  {
-    Print(L"Error getting memory map for ActuallyFreeAddress. 0x%llx\r\n", memmap_status);
-    return ~0ULL;
   }
 
-  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
-  // Check for EfiConventionalMemory in the map
-  for(Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+#if defined(MDE_CPU_X64) && defined(__GNUC__)
+  for(; i + 16 <= NumBytes; i += 16)
   {
-    // Within each compatible EfiConventionalMemory, look for space
-    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages >= pages) && (Piece->PhysicalStart > OldAddress))
+    UINT32 ZeroMask;
+
+    __asm__ __volatile__("pxor %%xmm1, %%xmm1\n\t"
+                         "movdqu (%1), %%xmm0\n\t"
+                         "pcmpeqb %%xmm1, %%xmm0\n\t"
+                         "pmovmskb %%xmm0, %0"
+                         : "=r" (ZeroMask) : "r" (Mem + i) : "xmm0", "xmm1", "memory");
+    if(ZeroMask != 0xFFFF)
     {
       break;
     }
   }
+#endif
 
-  // Loop ended without a DiscoveredAddress
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize))
+  for(; i + sizeof(UINTN) <= NumBytes; i += sizeof(UINTN))
   {
-    // Return address -1, which will cause AllocatePages to fail
-#ifdef MEMORY_CHECK_INFO
-    Print(L"No more free addresses...\r\n");
-#endif
-    return ~0ULL;
+    if(*(const UINTN*)(Mem + i) != 0)
+    {
+      break;
+    }
   }
 
-  memmap_status = gBS->FreePool(MemMap);
-  if(EFI_ERROR(memmap_status))
+  for(; i < NumBytes; i++)
   {
-    Print(L"Error freeing ActuallyFreeAddress memmap pool. 0x%llx\r\n", memmap_status);
+    if(Mem[i] != 0)
+    {
+      return i;
+    }
   }
+  return NumBytes;
+}
 
-  return Piece->PhysicalStart;
+//==================================================================================================================================
+//  VerifyZeroMem: Verify Memory Is Free
+//==================================================================================================================================
+//
+// Return 0 if desired section of memory is zeroed (for use in "if" statements)
+//
+
+UINT8 VerifyZeroMem(UINT64 NumBytes, UINT64 BaseAddr) // BaseAddr is a 64-bit unsigned int whose value is the memory address
+{
+#ifdef MEMORY_TIMING_DEBUG_ENABLED
+  UINT64 Start = AsmReadTsc();
+#endif
+
+  UINT64 Offset = FirstNonZero(NumBytes, BaseAddr);
+
+#ifdef MEMORY_TIMING_DEBUG_ENABLED
+  Print(L"VerifyZeroMem: %llu bytes at 0x%llx in %llu us, first non-zero at offset 0x%llx\r\n", NumBytes, BaseAddr, TscToUs(AsmReadTsc() - Start), Offset);
+#endif
+
+  return (Offset != NumBytes);
 }
 
 //==================================================================================================================================
-//  ActuallyFreeAddressByPage: Find A Free Memory Address, Bottom-Up, The Hard Way
+//  FreeRangeSnapshot: Snapshot Free Memory Ranges
 //==================================================================================================================================
 //
-// This is meant to work in the event that AllocateAnyPages fails, but could have other uses. Returns the next page address marked as
-// free (EfiConventionalMemory) that is > the supplied OldAddress.
+// Read the memory map into the iterator's buffer (growing it if needed) and collect the EfiConventionalMemory ranges that can
+// hold Iter->Pages pages, sorted by address. Unless Rebuild is set, an unchanged MapKey means the current snapshot is still
+// accurate and is kept as is, position and all.
 //
 
-EFI_PHYSICAL_ADDRESS ActuallyFreeAddressByPage(UINT64 pages, EFI_PHYSICAL_ADDRESS OldAddress)
+STATIC EFI_STATUS FreeRangeSnapshot(FREE_RANGE_ITER *Iter, BOOLEAN Rebuild)
 {
   EFI_STATUS memmap_status;
-  UINTN MemMapSize = 0, MemMapKey, MemMapDescriptorSize;
+  UINTN MemMapSize = Iter->MemMapBufferSize, MemMapKey, MemMapDescriptorSize;
   UINT32 MemMapDescriptorVersion;
-  EFI_MEMORY_DESCRIPTOR * MemMap = NULL;
   EFI_MEMORY_DESCRIPTOR * Piece;
-  EFI_PHYSICAL_ADDRESS PhysicalEnd;
-  EFI_PHYSICAL_ADDRESS DiscoveredAddress;
 
-  memmap_status = gBS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
-  if(memmap_status == EFI_BUFFER_TOO_SMALL)
+  memmap_status = gBS->GetMemoryMap(&MemMapSize, Iter->MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+  while(memmap_status == EFI_BUFFER_TOO_SMALL)
   {
-    memmap_status = gBS->AllocatePool(EfiBootServicesData, MemMapSize, (void **)&MemMap); // Allocate pool for MemMap
+    FreeRangeIterFree(Iter);
+
+    // The two pools allocated here add descriptors of their own
+    MemMapSize += 2 * MemMapDescriptorSize;
+
+    memmap_status = gBS->AllocatePool(EfiBootServicesData, MemMapSize, (void **)&Iter->MemMap);
     if(EFI_ERROR(memmap_status)) // Error! Wouldn't be safe to continue.
     {
-      Print(L"ActuallyFreeAddressByPage MemMap AllocatePool error. 0x%llx\r\n", memmap_status);
-      return ~0ULL;
+      Print(L"FreeRangeSnapshot MemMap AllocatePool error. 0x%llx\r\n", memmap_status);
+      return memmap_status;
     }
-    memmap_status = gBS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+    memmap_status = gBS->AllocatePool(EfiBootServicesData, (MemMapSize / MemMapDescriptorSize) * sizeof(FREE_RANGE), (void **)&Iter->Ranges);
+    if(EFI_ERROR(memmap_status))
+    {
+      Print(L"FreeRangeSnapshot Ranges AllocatePool error. 0x%llx\r\n", memmap_status);
+      return memmap_status;
+    }
+    Iter->MemMapBufferSize = MemMapSize;
+
+    memmap_status = gBS->GetMemoryMap(&MemMapSize, Iter->MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+    Rebuild = TRUE;
   }
   if(EFI_ERROR(memmap_status))
   {
-    Print(L"Error getting memory map for ActuallyFreeAddressByPage. 0x%llx\r\n", memmap_status);
-    return ~0ULL;
+    Print(L"Error getting memory map for FreeRangeSnapshot. 0x%llx\r\n", memmap_status);
+    return memmap_status;
   }
 
-  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
-  // Check for EfiConventionalMemory in the map
-  for(Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  if(!Rebuild && (MemMapKey == Iter->MapKey))
   {
-    // Within each compatible EfiConventionalMemory, look for space
-    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages >= pages))
+    return EFI_SUCCESS;
+  }
+
+#ifdef MEMORY_DEBUG_ENABLED
+  Print(L"Memory map key 0x%llx -> 0x%llx, rebuilding free ranges\r\n", (UINT64)Iter->MapKey, (UINT64)MemMapKey);
+#endif
+
+  Iter->MapKey = MemMapKey;
+  Iter->Count = 0;
+  Iter->Index = 0;
+
+  // Firmware usually hands the map out sorted already, so this insertion sort is close to a plain copy
+  for(Piece = Iter->MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Iter->MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages >= Iter->Pages))
     {
-      PhysicalEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT) - EFI_PAGE_MASK; // Get the end of this range, and use it to set a bound on the range (define a max returnable address).
-      // (pages*EFI_PAGE_SIZE) or (pages << EFI_PAGE_SHIFT) gives the size the kernel would take up in memory
-      if((OldAddress >= Piece->PhysicalStart) && ((OldAddress + (pages << EFI_PAGE_SHIFT)) < PhysicalEnd)) // Bounds check on OldAddress
-      {
-        // Return the next available page's address in the range. We need to go page-by-page for the really buggy systems.
-        DiscoveredAddress = OldAddress + EFI_PAGE_SIZE; // Left shift EFI_PAGE_SIZE by 1 or 2 to check every 0x10 or 0x100 pages (must also modify the above PhysicalEnd bound check)
-        break;
-        // If PhysicalEnd == OldAddress, we need to go to the next EfiConventionalMemory range
-      }
-      else if(Piece->PhysicalStart > OldAddress) // Try a new range
+      UINTN j = Iter->Count++;
+
+      for(; (j > 0) && (Iter->Ranges[j - 1].Start > Piece->PhysicalStart); j--)
       {
-        DiscoveredAddress = Piece->PhysicalStart;
-        break;
+        Iter->Ranges[j] = Iter->Ranges[j - 1];
       }
+      Iter->Ranges[j].Start = Piece->PhysicalStart;
+      Iter->Ranges[j].Pages = Piece->NumberOfPages;
     }
   }
 
-  // Loop ended without a DiscoveredAddress
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize))
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  FreeRangeIterInit: Start A Search For Free Memory, Bottom-Up
+//==================================================================================================================================
+//
+// This is meant to work in the event that AllocateAnyPages fails, but could have other uses. Snapshots the memory map once; the
+// candidates AllocateNextFreeRange() hands out are then taken from that snapshot without asking the firmware again.
+//
+// With ByPage clear, the candidates are the start of each EfiConventionalMemory range that fits 'pages'. With ByPage set, every page
+// address in such a range that still leaves room for 'pages' pages is a candidate too (the hard way, for really buggy systems).
+//
+
+EFI_STATUS FreeRangeIterInit(FREE_RANGE_ITER *Iter, UINT64 pages, BOOLEAN ByPage)
+{
+  SetMem(Iter, sizeof(*Iter), 0);
+  Iter->Pages = pages;
+  Iter->ByPage = ByPage;
+
+  return FreeRangeSnapshot(Iter, TRUE);
+}
+
+//==================================================================================================================================
+//  FreeRangeIterNext: Next Candidate Address
+//==================================================================================================================================
+//
+// Returns the next candidate address above the last one handed out, or ~0ULL once the snapshot is exhausted.
+//
+
+STATIC EFI_PHYSICAL_ADDRESS FreeRangeIterNext(FREE_RANGE_ITER *Iter)
+{
+  EFI_PHYSICAL_ADDRESS Candidate;
+
+  for(; Iter->Index < Iter->Count; Iter->Index++)
   {
-    // Return address -1, which will cause AllocatePages to fail
+    FREE_RANGE *Range = &Iter->Ranges[Iter->Index];
+
+    if(!Iter->Started || (Range->Start > Iter->Last))
+    {
+      Candidate = Range->Start;
+    }
+    else if(Iter->ByPage && ((Iter->Last + EFI_PAGE_SIZE + (Iter->Pages << EFI_PAGE_SHIFT)) <= (Range->Start + (Range->Pages << EFI_PAGE_SHIFT))))
+    {
+      Candidate = Iter->Last + EFI_PAGE_SIZE;
+    }
+    else
+    {
+      continue;
+    }
+
+    Iter->Started = TRUE;
+    Iter->Last = Candidate;
+    return Candidate;
+  }
+
+  return ~0ULL;
+}
+
+//==================================================================================================================================
+//  AllocateNextFreeRange: Allocate The Next Candidate
+//==================================================================================================================================
+//
+// Allocate Iter->Pages pages at the next candidate address that isn't 'Avoid' (a known bad address). If the firmware refuses a
+// candidate, the memory map is read again, and the snapshot rebuilt if MapKey shows the map changed since it was taken. Returns
+// EFI_NOT_FOUND with *Address = ~0ULL once there are no candidates left.
+//
+
+EFI_STATUS AllocateNextFreeRange(FREE_RANGE_ITER *Iter, EFI_MEMORY_TYPE MemoryType, EFI_PHYSICAL_ADDRESS Avoid, EFI_PHYSICAL_ADDRESS *Address)
+{
+  EFI_STATUS Status;
+
+  while(1)
+  {
+    *Address = FreeRangeIterNext(Iter);
+    if(*Address == Avoid)
+    {
+      *Address = FreeRangeIterNext(Iter);
+    }
+    if(*Address == ~0ULL)
+    {
 #ifdef MEMORY_CHECK_INFO
-    Print(L"No more free addresses by page...\r\n");
+      Print(L"No more free addresses%s...\r\n", Iter->ByPage ? L" by page" : L"");
 #endif
-    return ~0ULL;
+      return EFI_NOT_FOUND;
+    }
+
+    Status = gBS->AllocatePages(AllocateAddress, MemoryType, Iter->Pages, Address);
+    if(Status != EFI_NOT_FOUND)
+    {
+      return Status;
+    }
+
+    Status = FreeRangeSnapshot(Iter, FALSE);
+    if(EFI_ERROR(Status))
+    {
+      return Status;
+    }
   }
+}
 
-  memmap_status = gBS->FreePool(MemMap);
-  if(EFI_ERROR(memmap_status))
+//==================================================================================================================================
+//  FreeRangeIterFree: Release A Search's Buffers
+//==================================================================================================================================
+//
+// Frees the memory map and range buffers. Safe to call more than once.
+//
+
+VOID FreeRangeIterFree(FREE_RANGE_ITER *Iter)
+{
+  if(Iter->MemMap)
+  {
+    gBS->FreePool(Iter->MemMap);
+    Iter->MemMap = NULL;
+  }
+  if(Iter->Ranges)
   {
-    Print(L"Error freeing ActuallyFreeAddressByPage memmap pool. 0x%llx\r\n", memmap_status);
+    gBS->FreePool(Iter->Ranges);
+    Iter->Ranges = NULL;
   }
+  Iter->MemMapBufferSize = 0;
+  Iter->Count = 0;
+}
+
+//==================================================================================================================================
+//  CoalesceMemoryMap: Sorted, Merged Memory Map for the Kernel
+//==================================================================================================================================
+//
+// Turn the final memory map into MEMORY_RANGEs sorted by address, merging each range into the one before it when they are the same type
+// and touch. Returns the number of ranges, or 0 if MaxRanges isn't enough (the kernel then falls back to the raw map).
+//
+// This runs after ExitBootServices(), so it can't allocate anything or call any boot service. The firmware's map is almost always
+// sorted already, which makes the insertion sort a single pass.
+//
 
-  return DiscoveredAddress;
+UINTN CoalesceMemoryMap(EFI_MEMORY_DESCRIPTOR *MemMap, UINTN MemMapSize, UINTN MemMapDescriptorSize, MEMORY_RANGE *Ranges, UINTN MaxRanges)
+{
+  UINTN NumDescriptors = MemMapSize / MemMapDescriptorSize;
+  UINTN Count = 0;
+
+  if(Ranges == NULL || NumDescriptors > MaxRanges)
+  {
+    return 0;
+  }
+
+  // Copy and sort by address
+  for(UINTN i = 0; i < NumDescriptors; i++)
+  {
+    EFI_MEMORY_DESCRIPTOR *Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + i * MemMapDescriptorSize);
+    MEMORY_RANGE New;
+    UINTN j;
+
+    if(Piece->NumberOfPages == 0)
+    {
+      continue;
+    }
+    New.PhysicalStart = Piece->PhysicalStart;
+    New.NumberOfPages = Piece->NumberOfPages;
+    New.Type = Piece->Type;
+    New.Flags = (Piece->Type == EfiBootServicesCode || Piece->Type == EfiBootServicesData) ? MEMORY_RANGE_RECLAIMABLE : 0;
+
+    for(j = Count; j > 0 && Ranges[j - 1].PhysicalStart > New.PhysicalStart; j--)
+    {
+      Ranges[j] = Ranges[j - 1];
+    }
+    Ranges[j] = New;
+    Count++;
+  }
+
+  // Merge neighbours of the same type
+  UINTN Merged = 0;
+  for(UINTN i = 0; i < Count; i++)
+  {
+    if(Merged > 0 &&
+       Ranges[Merged - 1].Type == Ranges[i].Type &&
+       Ranges[Merged - 1].PhysicalStart + (Ranges[Merged - 1].NumberOfPages << EFI_PAGE_SHIFT) == Ranges[i].PhysicalStart)
+    {
+      Ranges[Merged - 1].NumberOfPages += Ranges[i].NumberOfPages;
+    }
+    else
+    {
+      Ranges[Merged++] = Ranges[i];
+    }
+  }
+
+  return Merged;
+}
+
+//==================================================================================================================================
+//  BuildPageDirectory: Initial 4 MiB Page Mappings for the Kernel
+//==================================================================================================================================
+//
+// Fill the page at PageDirectory with PSE entries that identity map every 4 MiB block holding RAM or a framebuffer below 4 GB, and alias
+// blocks of the first 256 MiB at LOADER_HIGH_HALF_BASE where nothing is identity mapped there already. Framebuffer blocks set the PAT
+// bit so the kernel can make them write-combining by pointing PAT entry 4 at WC; until it does, entry 4 is write-back like entry 0.
+//
+// Like CoalesceMemoryMap(), this runs after ExitBootServices() and works only from the Ranges it is given.
+//
+
+STATIC BOOLEAN IsRamType(UINT32 Type)
+{
+  switch(Type)
+  {
+    case EfiLoaderCode:
+    case EfiLoaderData:
+    case EfiBootServicesCode:
+    case EfiBootServicesData:
+    case EfiRuntimeServicesCode:
+    case EfiRuntimeServicesData:
+    case EfiConventionalMemory:
+    case EfiACPIReclaimMemory:
+    case EfiACPIMemoryNVS:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+STATIC VOID MapLargePages(UINT32 *PageDirectory, UINT64 Start, UINT64 Length, UINT32 Flags)
+{
+  UINT64 End = Start + Length;
+
+  if(Length == 0 || Start >= BASE_4GB)
+  {
+    return;
+  }
+  if(End > BASE_4GB)
+  {
+    End = BASE_4GB;
+  }
+
+  for(UINT64 Pde = RShiftU64(Start, PDE_LARGE_SHIFT); Pde <= RShiftU64(End - 1, PDE_LARGE_SHIFT); Pde++)
+  {
+    PageDirectory[Pde] = ((UINT32)Pde << PDE_LARGE_SHIFT) | PDE_PRESENT | PDE_WRITE | PDE_LARGE | Flags;
+  }
+}
+
+VOID BuildPageDirectory(UINT32 *PageDirectory, MEMORY_RANGE *Ranges, UINTN NumRanges, GPU_CONFIG *Graphics)
+{
+  UINTN HighPde = (UINTN)RShiftU64(LOADER_HIGH_HALF_BASE, PDE_LARGE_SHIFT);
+
+  ZeroMem(PageDirectory, EFI_PAGE_SIZE);
+
+  // Framebuffers go in first so RAM overrides them: a block shared with RAM must stay write-back, since write-combining memory is
+  // uncached for reads and weakly ordered for writes
+  for(UINT64 k = 0; Graphics != NULL && k < Graphics->NumberOfFrameBuffers; k++)
+  {
+    MapLargePages(PageDirectory, Graphics->GPUArray[k].FrameBufferBase, Graphics->GPUArray[k].FrameBufferSize, PDE_LARGE_PAT);
+  }
+
+  for(UINTN i = 0; i < NumRanges; i++)
+  {
+    if(IsRamType(Ranges[i].Type))
+    {
+      MapLargePages(PageDirectory, Ranges[i].PhysicalStart, LShiftU64(Ranges[i].NumberOfPages, EFI_PAGE_SHIFT), 0);
+    }
+  }
+
+  // High-half alias of low memory
+  for(UINTN Pde = 0; HighPde + Pde < EFI_PAGE_SIZE / sizeof(UINT32); Pde++)
+  {
+    if(PageDirectory[Pde] != 0 && PageDirectory[HighPde + Pde] == 0)
+    {
+      PageDirectory[HighPde + Pde] = PageDirectory[Pde];
+    }
+  }
 }
 
 //==================================================================================================================================
@@ -0,0 +1,168 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Boot Module Loader
+//==================================================================================================================================
+//
+// This file contains the code that loads the boot modules listed after the kernel command line in Kernel64.txt.
+//
+
+#include "Bootloader.h"
+
+//==================================================================================================================================
+//  LoadBootModule: Load One File Into Page-Aligned Memory
+//==================================================================================================================================
+//
+// Read the file at Path (relative to the ESP root) into freshly allocated EfiLoaderData pages, so it stays put for the kernel, and
+// describe it in Module. The tail of the last page is zeroed so the kernel can map the module's pages as they are.
+//
+
+STATIC EFI_STATUS LoadBootModule(EFI_FILE *Root, CHAR16 *Path, BOOT_MODULE *Module)
+{
+  EFI_STATUS Status;
+  EFI_FILE *File;
+  EFI_FILE_INFO *Info;
+  UINTN InfoSize = 0;
+  UINTN i, n;
+
+  Module->Size = 0;
+  Status = Root->Open(Root, &File, Path, EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY);
+  if(EFI_ERROR(Status))
+  {
+    return Status;
+  }
+
+  Status = File->GetInfo(File, &gEfiFileInfoGuid, &InfoSize, NULL); // Will error intentionally to get the size
+  Status = gBS->AllocatePool(EfiBootServicesData, InfoSize, (void**)&Info);
+  if(!EFI_ERROR(Status))
+  {
+    Status = File->GetInfo(File, &gEfiFileInfoGuid, &InfoSize, Info);
+    Module->Size = Info->FileSize;
+    gBS->FreePool(Info);
+  }
+
+  Module->Base = 0;
+  Module->Pages = EFI_SIZE_TO_PAGES(Module->Size);
+  if(!EFI_ERROR(Status) && (Module->Pages != 0))
+  {
+    Status = gBS->AllocatePages(AllocateAnyPages, EfiLoaderData, Module->Pages, &Module->Base);
+    if(!EFI_ERROR(Status))
+    {
+      Status = StreamReadFile(File, (VOID*)(UINTN)Module->Base, Module->Size);
+      if(EFI_ERROR(Status))
+      {
+        gBS->FreePages(Module->Base, Module->Pages);
+      }
+      else
+      {
+        ZeroMem((VOID*)(UINTN)(Module->Base + Module->Size), (UINTN)(EFI_PAGES_TO_SIZE(Module->Pages) - Module->Size));
+      }
+    }
+  }
+  File->Close(File);
+
+  // The name is the file name without its directory, as ASCII
+  for(i = 0, n = 0; Path[i] != L'\0'; i++)
+  {
+    if((Path[i] == L'\\') || (Path[i] == L'/'))
+    {
+      n = i + 1;
+    }
+  }
+  for(i = 0; (i < BOOT_MODULE_NAME_LEN - 1) && (Path[n + i] != L'\0'); i++)
+  {
+    Module->Name[i] = (Path[n + i] < 0x80) ? (CHAR8)Path[n + i] : '?';
+  }
+  Module->Name[i] = '\0';
+
+  return Status;
+}
+
+//==================================================================================================================================
+//  LoadBootModules: Load Every Module Listed in Kernel64.txt
+//==================================================================================================================================
+//
+// List holds the lines of Kernel64.txt after the command line, one module path per line. Blank lines and lines starting with '#' are
+// skipped, as are spaces around a path. A module that can't be loaded is reported and left out rather than stopping the boot, since
+// the kernel can check for the ones it needs. At most BOOT_MODULES_MAX modules are loaded.
+//
+// *Modules is allocated as EfiLoaderData for the kernel, or left NULL if there are no modules.
+//
+
+EFI_STATUS LoadBootModules(EFI_FILE *Root, CONST CHAR16 *List, BOOT_MODULE **Modules, UINTN *NumModules)
+{
+  EFI_STATUS Status;
+  CHAR16 Path[BOOT_MODULE_PATH_LEN];
+  CONST CHAR16 *Line, *End;
+  UINTN Count = 0, Len;
+
+  *Modules = NULL;
+  *NumModules = 0;
+
+  // Count the lines that name a module
+  for(Line = List; *Line != L'\0'; Line = (*End != L'\0') ? End + 1 : End)
+  {
+    for(End = Line; (*End != L'\0') && (*End != L'\n') && (*End != L'\r'); End++);
+    while((Line < End) && (*Line == L' '))
+    {
+      Line++;
+    }
+    if((Line < End) && (*Line != L'#'))
+    {
+      Count++;
+    }
+  }
+  if(Count == 0)
+  {
+    return EFI_SUCCESS;
+  }
+  if(Count > BOOT_MODULES_MAX)
+  {
+    Print(L"Only loading the first %u of %llu boot modules\r\n", BOOT_MODULES_MAX, Count);
+    Count = BOOT_MODULES_MAX;
+  }
+
+  Status = gBS->AllocatePool(EfiLoaderData, Count * sizeof(BOOT_MODULE), (void**)Modules);
+  if(EFI_ERROR(Status))
+  {
+    Print(L"Modules AllocatePool error. 0x%llx\r\n", Status);
+    *Modules = NULL;
+    return Status;
+  }
+
+  for(Line = List; (*Line != L'\0') && (*NumModules < Count); Line = (*End != L'\0') ? End + 1 : End)
+  {
+    for(End = Line; (*End != L'\0') && (*End != L'\n') && (*End != L'\r'); End++);
+    while((Line < End) && (*Line == L' '))
+    {
+      Line++;
+    }
+    if((Line == End) || (*Line == L'#'))
+    {
+      continue;
+    }
+
+    for(Len = End - Line; (Len > 0) && (Line[Len - 1] == L' '); Len--);
+    if(Len >= BOOT_MODULE_PATH_LEN)
+    {
+      Print(L"Boot module path too long, skipping it\r\n");
+      continue;
+    }
+    CopyMem(Path, Line, Len * sizeof(CHAR16));
+    Path[Len] = L'\0';
+
+#ifdef LOAD_TIME_INFO
+    UINT64 Start = AsmReadTsc();
+#endif
+    Status = LoadBootModule(Root, Path, &(*Modules)[*NumModules]);
+    if(EFI_ERROR(Status))
+    {
+      Print(L"Boot module %s not loaded. 0x%llx\r\n", Path, Status);
+      continue;
+    }
+#ifdef LOAD_TIME_INFO
+    Print(L"Module %s: %llu KiB at 0x%llx in %llu us\r\n", Path, (*Modules)[*NumModules].Size >> 10, (*Modules)[*NumModules].Base, TscToUs(AsmReadTsc() - Start));
+#endif
+    (*NumModules)++;
+  }
+
+  return EFI_SUCCESS;
+}
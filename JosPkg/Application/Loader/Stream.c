@@ -0,0 +1,174 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Streaming ELF Segment Loader
+//==================================================================================================================================
+//
+// This file contains the single-pass kernel segment loader used when STREAMING_ELF_LOAD is defined.
+//
+
+#include "Bootloader.h"
+
+//==================================================================================================================================
+//  StreamLoadSegments: Load All PT_LOAD Segments In One Pass Over The File
+//==================================================================================================================================
+//
+// Some firmware FAT drivers turn every Read() into a slow sector-at-a-time transfer, so one SetPosition() + Read() per segment adds
+// up. Instead, sort the PT_LOAD segments by file offset and read the file front to back in STREAM_CHUNK_SIZE pieces.
+//
+// A chunk that lies entirely inside one segment (and no other) is read straight to its destination. Any other chunk goes through
+// a page-aligned bounce buffer and is scattered to every segment it overlaps. Gaps of more than a chunk between segments are
+// skipped with SetPosition(). BSS tails are left to the caller.
+//
+
+EFI_STATUS StreamLoadSegments(EFI_FILE *KernelFile, struct Proghdr *ProgramHeaders, UINT64 NumProgramHeaders)
+{
+  EFI_STATUS Status;
+  struct Proghdr **Sorted;
+  UINTN Count = 0, Seg, j;
+  EFI_PHYSICAL_ADDRESS Buffer;
+  UINT64 Pos, Reads = 0, BytesRead = 0;
+  UINTN Size;
+
+  Status = gBS->AllocatePool(EfiBootServicesData, NumProgramHeaders * sizeof(struct Proghdr *), (void**)&Sorted);
+  if(EFI_ERROR(Status))
+  {
+    Print(L"StreamLoadSegments AllocatePool error. 0x%llx\r\n", Status);
+    return Status;
+  }
+
+  // Insertion sort by p_offset; there are only ever a handful
+  for(UINT64 i = 0; i < NumProgramHeaders; i++)
+  {
+    struct Proghdr *Phdr = &ProgramHeaders[i];
+
+    if((Phdr->p_type != ELF_PROG_LOAD) || (Phdr->p_filesz == 0))
+    {
+      continue;
+    }
+    for(j = Count++; (j > 0) && (Sorted[j - 1]->p_offset > Phdr->p_offset); j--)
+    {
+      Sorted[j] = Sorted[j - 1];
+    }
+    Sorted[j] = Phdr;
+  }
+
+  if(Count == 0)
+  {
+    gBS->FreePool(Sorted);
+    return EFI_SUCCESS;
+  }
+
+  Status = gBS->AllocatePages(AllocateAnyPages, EfiBootServicesData, EFI_SIZE_TO_PAGES(STREAM_CHUNK_SIZE), &Buffer);
+  if(EFI_ERROR(Status))
+  {
+    Print(L"StreamLoadSegments buffer AllocatePages error. 0x%llx\r\n", Status);
+    gBS->FreePool(Sorted);
+    return Status;
+  }
+
+#ifdef LOAD_TIME_INFO
+  UINT64 Start = AsmReadTsc();
+#endif
+
+  // Start reading on a page boundary; firmware tends to like aligned reads better
+  Pos = Sorted[0]->p_offset & ~(UINT64)EFI_PAGE_MASK;
+  Status = KernelFile->SetPosition(KernelFile, Pos);
+
+  for(Seg = 0; !EFI_ERROR(Status) && (Seg < Count); )
+  {
+    struct Proghdr *Phdr = Sorted[Seg];
+    UINT64 SegEnd = (UINT64)Phdr->p_offset + Phdr->p_filesz;
+
+    if(Pos >= SegEnd) // Done with this one
+    {
+      Seg++;
+      continue;
+    }
+
+    if((Pos >= Phdr->p_offset) && (SegEnd - Pos >= STREAM_CHUNK_SIZE) && ((Seg + 1 == Count) || (Sorted[Seg + 1]->p_offset >= Pos + STREAM_CHUNK_SIZE)))
+    {
+      // Entirely inside this segment: read it in place
+      Size = STREAM_CHUNK_SIZE;
+      Status = KernelFile->Read(KernelFile, &Size, (VOID*)(uintptr_t)(Phdr->p_pa + (Pos - Phdr->p_offset)));
+    }
+    else if(Phdr->p_offset > Pos + STREAM_CHUNK_SIZE)
+    {
+      // Nothing wanted in the next chunk; jump ahead to the segment
+      Pos = Phdr->p_offset & ~(UINT64)EFI_PAGE_MASK;
+      Status = KernelFile->SetPosition(KernelFile, Pos);
+      continue;
+    }
+    else
+    {
+      Size = STREAM_CHUNK_SIZE;
+      Status = KernelFile->Read(KernelFile, &Size, (VOID*)(uintptr_t)Buffer);
+      if(!EFI_ERROR(Status))
+      {
+        // Scatter to everything the chunk [Pos, Pos + Size) overlaps
+        for(j = Seg; (j < Count) && (Sorted[j]->p_offset < Pos + Size); j++)
+        {
+          UINT64 From = (Pos > Sorted[j]->p_offset) ? Pos : Sorted[j]->p_offset;
+          UINT64 To = (Pos + Size < (UINT64)Sorted[j]->p_offset + Sorted[j]->p_filesz) ? Pos + Size : (UINT64)Sorted[j]->p_offset + Sorted[j]->p_filesz;
+
+          if(From < To)
+          {
+            CopyMem((VOID*)(uintptr_t)(Sorted[j]->p_pa + (From - Sorted[j]->p_offset)), (VOID*)(uintptr_t)(Buffer + (From - Pos)), (UINTN)(To - From));
+          }
+        }
+      }
+    }
+
+    if(!EFI_ERROR(Status) && (Size == 0)) // End of file with segment data still missing
+    {
+      Status = EFI_END_OF_FILE;
+    }
+    Pos += Size;
+    BytesRead += Size;
+    Reads++;
+  }
+
+  if(EFI_ERROR(Status))
+  {
+    Print(L"Streaming segment load error at file offset 0x%llx (ELF). 0x%llx\r\n", Pos, Status);
+  }
+#ifdef LOAD_TIME_INFO
+  else
+  {
+    UINT64 Us = TscToUs(AsmReadTsc() - Start);
+
+    // Bytes per microsecond is (decimal) megabytes per second
+    Print(L"Streamed %llu KiB in %llu reads of up to %u KiB: %llu ms, %llu MB/s\r\n", BytesRead >> 10, Reads, STREAM_CHUNK_SIZE >> 10, DivU64x32(Us, 1000), Us ? DivU64x64Remainder(BytesRead, Us, NULL) : 0);
+  }
+#endif
+
+  gBS->FreePages(Buffer, EFI_SIZE_TO_PAGES(STREAM_CHUNK_SIZE));
+  gBS->FreePool(Sorted);
+  return Status;
+}
+
+//==================================================================================================================================
+//  StreamReadFile: Read a Whole File In STREAM_CHUNK_SIZE Pieces
+//==================================================================================================================================
+//
+// Read Size bytes from the current position of File straight into Buffer, using the same large reads as StreamLoadSegments(). Used
+// for boot modules, which need no scattering.
+//
+
+EFI_STATUS StreamReadFile(EFI_FILE *File, VOID *Buffer, UINT64 Size)
+{
+  EFI_STATUS Status = EFI_SUCCESS;
+  UINT64 Pos = 0;
+  UINTN Chunk;
+
+  while(!EFI_ERROR(Status) && (Pos < Size))
+  {
+    Chunk = (Size - Pos < STREAM_CHUNK_SIZE) ? (UINTN)(Size - Pos) : STREAM_CHUNK_SIZE;
+    Status = File->Read(File, &Chunk, (UINT8*)Buffer + Pos);
+    if(!EFI_ERROR(Status) && (Chunk == 0)) // File shrank under us
+    {
+      Status = EFI_END_OF_FILE;
+    }
+    Pos += Chunk;
+  }
+
+  return Status;
+}
@@ -0,0 +1,92 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Timing Functions
+//==================================================================================================================================
+//
+// This file contains TSC-based timing helpers for measuring how long loader steps take, and the boot phase stamps passed to the kernel.
+//
+
+#include "Bootloader.h"
+
+STATIC UINT64 TscPerMs = 0;
+
+STATIC BOOT_TIMING BootTiming = { BOOT_TIMING_VERSION, 0, 0 };
+
+//==================================================================================================================================
+//  TscTicksPerMs: TSC Calibration
+//==================================================================================================================================
+//
+// Count TSC ticks across a 10 ms Stall() the first time this is called. Stall() is good to about a microsecond on real firmware,
+// whereas GetTime() often only has one-second resolution, so it is no use for timing anything this short.
+//
+
+UINT64 TscTicksPerMs(VOID)
+{
+  if(TscPerMs == 0)
+  {
+    UINT64 Start = AsmReadTsc();
+    gBS->Stall(10000);
+    TscPerMs = DivU64x32(AsmReadTsc() - Start, 10);
+    if(TscPerMs == 0) // Emulators without a real TSC
+    {
+      TscPerMs = 1;
+    }
+  }
+  return TscPerMs;
+}
+
+//==================================================================================================================================
+//  TscToMs: TSC Ticks to Milliseconds
+//==================================================================================================================================
+//
+// Convert a TSC tick count to whole milliseconds.
+//
+
+UINT64 TscToMs(UINT64 Ticks)
+{
+  return DivU64x64Remainder(Ticks, TscTicksPerMs(), NULL);
+}
+
+//==================================================================================================================================
+//  TscToUs: TSC Ticks to Microseconds
+//==================================================================================================================================
+//
+// Convert a TSC tick count to whole microseconds.
+//
+
+UINT64 TscToUs(UINT64 Ticks)
+{
+  return DivU64x64Remainder(MultU64x32(Ticks, 1000), TscTicksPerMs(), NULL);
+}
+
+//==================================================================================================================================
+//  BootStamp: Record the End of a Boot Phase
+//==================================================================================================================================
+//
+// Append a TSC stamp for the boot phase Id (one of the BOOT_STAMP_* values). Safe to call after ExitBootServices().
+//
+
+VOID BootStamp(UINT32 Id)
+{
+  UINT64 Tsc = AsmReadTsc();
+
+  if(BootTiming.Count < BOOT_TIMING_MAX_STAMPS)
+  {
+    BootTiming.Stamps[BootTiming.Count].Id = Id;
+    BootTiming.Stamps[BootTiming.Count].Tsc = Tsc;
+    BootTiming.Count++;
+  }
+}
+
+//==================================================================================================================================
+//  BootTimingSave: Hand the Boot Stamps to the Kernel
+//==================================================================================================================================
+//
+// Copy the stamps so far into the loader block. This never calibrates the TSC itself, since Stall() may already be gone; TscPerMs is
+// only filled in if something like LOAD_TIME_INFO calibrated it earlier, and the kernel calibrates against the PIT either way.
+//
+
+VOID BootTimingSave(BOOT_TIMING *Dest)
+{
+  BootTiming.TscPerMs = TscPerMs;
+  CopyMem(Dest, &BootTiming, sizeof(BOOT_TIMING));
+}
@@ -0,0 +1,135 @@
+#include <inc/x86.h>
+
+/**********************************************************************
+ * Bus-master IDE DMA for the second-stage boot loader.
+ *
+ * The IDE function of the PIIX3/PIIX4 south bridge (the one QEMU
+ * emulates, at PCI 00:01.1) can copy sectors from the disk straight
+ * into memory while we wait.  We find it on PCI bus 0, hand it a
+ * table of physical regions (PRDs) to fill, and issue one READ DMA EXT
+ * per DMA_MAXSECTS sectors, so a multi-megabyte kernel takes a few
+ * commands instead of one per 255 sectors of PIO.
+ *
+ * dma_readsects() returns 0 whenever DMA isn't available or fails,
+ * and boot/main.c falls back to PIO.
+ **********************************************************************/
+
+#define SECTSIZE	512
+#define DMA_MAXSECTS	8192	// 4MB per command
+#define PRDT		((struct Prd *) 0xF000) // scratch space below ELFHDR
+#define PRD_EOT		0x8000	// last entry in the table
+
+// One physical region for the controller to fill.  A region may not
+// cross a 64KB boundary; a length of 0 means 64KB.
+struct Prd {
+	uint32_t addr;
+	uint16_t len;
+	uint16_t flags;
+};
+
+// Bus-master registers of the primary channel, at BAR4 of the IDE
+// function
+#define BM_CMD		0	// bit 0 start, bit 3 transfer to memory
+#define BM_STATUS	2	// bit 0 active, bit 1 error, bit 2 interrupt
+#define BM_PRDT		4	// physical address of the PRD table
+
+static uint32_t
+pci_conf_read(uint32_t devfn, uint32_t off)
+{
+	outl(0xCF8, 0x80000000 | (devfn << 8) | off);
+	return inl(0xCFC);
+}
+
+static void
+pci_conf_write(uint32_t devfn, uint32_t off, uint32_t v)
+{
+	outl(0xCF8, 0x80000000 | (devfn << 8) | off);
+	outl(0xCFC, v);
+}
+
+// Find a bus-master capable IDE controller on PCI bus 0, switch on
+// its I/O decoding and bus mastering, and return its bus-master I/O
+// base, or 0 if there is none.
+static uint32_t
+ide_busmaster(void)
+{
+	uint32_t devfn, bar4;
+
+	for (devfn = 0; devfn < 256; devfn++) {
+		if ((pci_conf_read(devfn, 0x00) & 0xFFFF) == 0xFFFF)
+			continue;
+		// class 01 (storage), subclass 01 (IDE), prog-if bit 7
+		if ((pci_conf_read(devfn, 0x08) >> 8 & 0xFFFF80) != 0x010180)
+			continue;
+		bar4 = pci_conf_read(devfn, 0x20);
+		if (!(bar4 & 1) || !(bar4 & ~3))
+			continue;
+		pci_conf_write(devfn, 0x04, pci_conf_read(devfn, 0x04) | 0x5);
+		return bar4 & ~3;
+	}
+	return 0;
+}
+
+// Read up to 'count' sectors at 'offset' into physical address 'dst'
+// with one DMA command.  Returns the number of sectors read, or 0 if
+// nothing was.
+uint32_t
+dma_readsects(void *dst, uint32_t offset, uint32_t count)
+{
+	uint32_t bm, pa, len, n, i;
+	uint8_t s;
+
+	if (!(bm = ide_busmaster()))
+		return 0;
+	if (count > DMA_MAXSECTS)
+		count = DMA_MAXSECTS;
+
+	// Split the destination at 64KB boundaries
+	pa = (uint32_t) dst;
+	for (i = 0, len = count * SECTSIZE; len > 0; i++) {
+		n = 0x10000 - (pa & 0xFFFF);
+		if (n > len)
+			n = len;
+		PRDT[i].addr = pa;
+		PRDT[i].len = n;
+		PRDT[i].flags = 0;
+		pa += n;
+		len -= n;
+	}
+	PRDT[i - 1].flags = PRD_EOT;
+
+	// wait for disk to be ready
+	while ((inb(0x1F7) & 0xC0) != 0x40)
+		/* do nothing */;
+
+	outb(bm + BM_CMD, 0);
+	outb(bm + BM_STATUS, 0x06);	// clear error and interrupt
+	outl(bm + BM_PRDT, (uint32_t) PRDT);
+	outb(bm + BM_CMD, 0x08);
+
+	// 48-bit LBA: high bytes first, then low bytes
+	outb(0x1F6, 0xE0);
+	outb(0x1F2, count >> 8);
+	outb(0x1F3, offset >> 24);
+	outb(0x1F4, 0);
+	outb(0x1F5, 0);
+	outb(0x1F2, count);
+	outb(0x1F3, offset);
+	outb(0x1F4, offset >> 8);
+	outb(0x1F5, offset >> 16);
+	outb(0x1F7, 0x25);	// cmd 0x25 - read DMA ext
+
+	outb(bm + BM_CMD, 0x09);	// go
+
+	// wait until the transfer ends or the disk interrupts (done or
+	// failed)
+	while (((s = inb(bm + BM_STATUS)) & 0x07) == 0x01)
+		/* do nothing */;
+	outb(bm + BM_CMD, 0);
+	outb(bm + BM_STATUS, 0x06);
+
+	// disk error or fault, or a controller error
+	if ((s & 0x02) || (inb(0x1F7) & 0x21))
+		return 0;
+	return count;
+}
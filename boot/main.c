@@ -27,18 +27,50 @@
  *    and a stack so C code then run, then calls bootmain()
  *
  *  * bootmain() in this file takes over, reads in the kernel and jumps to it.
+ *
+ * SECOND STAGE
+ *  * With CONFIG_BOOT_STAGE2=y, sectors 1 to BOOT_STAGE2_SECTS hold a
+ *    second stage (boot/stage2.S, this file built with BOOT_DMA, and
+ *    boot/dma.c) and the kernel follows it.  The boot sector's
+ *    bootmain() only loads the second stage and jumps to it; the
+ *    second stage's bootmain() loads the kernel with bus-master DMA,
+ *    falling back to PIO.
  **********************************************************************/
 
 #define SECTSIZE	512
+#define MAXSECTS	255	// most sectors one read command can ask for
 #define ELFHDR		((struct Elf *) 0x10000) // scratch space
 
-void readsect(void*, uint32_t);
+#ifdef BOOT_STAGE2_SECTS
+#define STAGE2ADDR	0x7E00	// right after the boot sector
+#define KERNSECT	(1 + BOOT_STAGE2_SECTS)
+#else
+#define KERNSECT	1
+#endif
+
+void readsects(void*, uint32_t, uint32_t);
 void readseg(uint32_t, uint32_t, uint32_t);
+uint32_t dma_readsects(void*, uint32_t, uint32_t);
+
+#if defined(BOOT_STAGE2_SECTS) && !defined(BOOT_DMA)
+
+void
+bootmain(void)
+{
+	readsects((void *) STAGE2ADDR, 1, BOOT_STAGE2_SECTS);
+	((void (*)(void)) STAGE2ADDR)();
+	while (1)
+		/* do nothing */;
+}
+
+#else
 
 void
 bootmain(void)
 {
 	struct Proghdr *ph, *eph;
+	uint8_t *bss;
+	uint32_t n, words;
 
 	// read 1st page off disk
 	readseg((uint32_t) ELFHDR, SECTSIZE*8, 0);
@@ -50,14 +82,29 @@ bootmain(void)
 	// load each program segment (ignores ph flags)
 	ph = (struct Proghdr *) ((uint8_t *) ELFHDR + ELFHDR->e_phoff);
 	eph = ph + ELFHDR->e_phnum;
-	for (; ph < eph; ph++)
+	for (; ph < eph; ph++) {
 		// p_pa is the load address of this segment (as well
 		// as the physical address)
-		readseg(ph->p_pa, ph->p_memsz, ph->p_offset);
+		readseg(ph->p_pa, ph->p_filesz, ph->p_offset);
+		// The rest (BSS) isn't in the file: zero it in place rather
+		// than reading whatever follows the segment on disk.  This
+		// also clears the partial sector readseg read past p_filesz.
+		// Whole dwords, then the odd bytes, so that nothing past
+		// p_memsz is touched.
+		bss = (uint8_t *) ph->p_pa + ph->p_filesz;
+		n = ph->p_memsz - ph->p_filesz;
+		words = n / 4;
+		n %= 4;
+		asm volatile("cld; rep stosl\n"
+			: "+D" (bss), "+c" (words) : "a" (0) : "cc", "memory");
+		asm volatile("rep stosb\n"
+			: "+D" (bss), "+c" (n) : "a" (0) : "cc", "memory");
+	}
 
-	// call the entry point from the ELF header
+	// call the entry point from the ELF header, with no loader
+	// parameter block (the kernel takes a LOADER_PARAMS *)
 	// note: does not return!
-	((void (*)(void)) (ELFHDR->e_entry))();
+	((void (*)(void *)) (ELFHDR->e_entry))(0);
 
 bad:
 	outw(0x8A00, 0x8A00);
@@ -66,35 +113,57 @@ bad:
 		/* do nothing */;
 }
 
+// Read as many of 'count' sectors at 'offset' into 'dst' as one disk
+// command allows, and return how many that was.
+static uint32_t
+readsome(void *dst, uint32_t offset, uint32_t count)
+{
+#ifdef BOOT_DMA
+	uint32_t n;
+
+	// DMA takes far more sectors per command; PIO is the fallback
+	if ((n = dma_readsects(dst, offset, count)) > 0)
+		return n;
+#endif
+	if (count > MAXSECTS)
+		count = MAXSECTS;
+	readsects(dst, offset, count);
+	return count;
+}
+
 // Read 'count' bytes at 'offset' from kernel into physical address 'pa'.
 // Might copy more than asked
 void
 readseg(uint32_t pa, uint32_t count, uint32_t offset)
 {
-	uint32_t end_pa;
+	uint32_t end_pa, n;
 
 	end_pa = pa + count;
 
 	// round down to sector boundary
 	pa &= ~(SECTSIZE - 1);
 
-	// translate from bytes to sectors, and kernel starts at sector 1
-	offset = (offset / SECTSIZE) + 1;
+	// translate from bytes to sectors; the kernel starts at KERNSECT
+	offset = (offset / SECTSIZE) + KERNSECT;
 
-	// If this is too slow, we could read lots of sectors at a time.
-	// We'd write more to memory than asked, but it doesn't matter --
-	// we load in increasing order.
+	// Read as many sectors per disk command as we can, since each
+	// command costs a full round trip to the disk.  We may write
+	// past end_pa to the end of its sector, but it doesn't
+	// matter -- we load in increasing order.
 	while (pa < end_pa) {
 		// Since we haven't enabled paging yet and we're using
 		// an identity segment mapping (see boot.S), we can
 		// use physical addresses directly.  This won't be the
 		// case once JOS enables the MMU.
-		readsect((uint8_t*) pa, offset);
-		pa += SECTSIZE;
-		offset++;
+		n = readsome((uint8_t*) pa, offset,
+			     (end_pa - pa + SECTSIZE - 1) / SECTSIZE);
+		pa += n * SECTSIZE;
+		offset += n;
 	}
 }
 
+#endif
+
 void
 waitdisk(void)
 {
@@ -104,22 +173,31 @@ waitdisk(void)
 }
 
 void
-readsect(void *dst, uint32_t offset)
+waitdrq(void)
+{
+	// wait for disk not busy and holding a sector for us (DRQ)
+	while ((inb(0x1F7) & 0x88) != 0x08)
+		/* do nothing */;
+}
+
+void
+readsects(void *dst, uint32_t offset, uint32_t count)
 {
 	// wait for disk to be ready
 	waitdisk();
 
-	outb(0x1F2, 1);		// count = 1
+	outb(0x1F2, count);	// 1 to MAXSECTS sectors
 	outb(0x1F3, offset);
 	outb(0x1F4, offset >> 8);
 	outb(0x1F5, offset >> 16);
 	outb(0x1F6, (offset >> 24) | 0xE0);
 	outb(0x1F7, 0x20);	// cmd 0x20 - read sectors
 
-	// wait for disk to be ready
-	waitdisk();
-
-	// read a sector
-	insl(0x1F0, dst, SECTSIZE/4);
+	// the disk raises DRQ as each sector becomes ready to read
+	for (; count > 0; count--) {
+		waitdrq();
+		insl(0x1F0, dst, SECTSIZE/4);
+		dst = (uint8_t *) dst + SECTSIZE;
+	}
 }
 
@@ -18,3 +18,35 @@ V = @
 # following line and set it to the full path to QEMU.
 #
 # QEMU=
+
+# Uncomment to compile the PROBE() hot-path counters into the kernel
+# (see inc/probe.h and the monitor's 'probes' command).
+#
+# CONFIG_PROBES=y
+
+# Uncomment to build the kernel with link-time optimization, and/or
+# with profile-guided optimization from a profile run (see 'make
+# bench-pgo' and gradelib.py, which take care of the three builds).
+#
+# LTO=1
+# PGO=gen
+# PGO=use
+
+# Uncomment to boot through a second-stage loader that reads the kernel
+# with bus-master IDE DMA instead of PIO (see boot/main.c and boot/dma.c).
+#
+# CONFIG_BOOT_STAGE2=y
+
+# 'make uefi-image' (obj/uefi.img) and 'make qemu-uefi': where the JosPkg
+# loader and the OVMF firmware were built, plus the kernel command line
+# and boot modules to put in Kernel64.txt.
+#
+# UEFI_LOADER=$(HOME)/edk2/Build/Jos/DEBUG_GCC5/IA32/Loader.efi
+# UEFI_OVMF=$(HOME)/edk2/Build/OvmfIa32/DEBUG_GCC5/FV/OVMF.fd
+# UEFI_KERNEL_OPTIONS=gop=max
+# UEFI_MODULES=
+
+# Number of CPUs 'make qemu-uefi' gives the guest (the monitor's 'cpus'
+# command shows which came up).
+#
+# CPUS=4
@@ -394,6 +394,31 @@ __all__ += ["TerminateTest", "Runner"]
 class TerminateTest(Exception):
     pass
 
+def react(reactors, timeout):
+    """Feed output from reactors (QEMU or GDBClient instances) to
+    their handlers until one raises TerminateTest, they all close, or
+    timeout seconds pass.  Returns False on a timeout."""
+
+    deadline = time.time() + timeout
+    try:
+        while True:
+            timeleft = deadline - time.time()
+            if timeleft < 0:
+                sys.stdout.write("Timeout! ")
+                sys.stdout.flush()
+                return False
+
+            rset = [r for r in reactors if r.fileno() is not None]
+            if not rset:
+                return True
+
+            rset, _, _ = select.select(rset, [], [], timeleft)
+            for reactor in rset:
+                reactor.handle_read()
+    except TerminateTest:
+        pass
+    return True
+
 class Runner():
     def __init__(self, *default_monitors):
         self.__default_monitors = default_monitors
@@ -465,24 +490,7 @@ Failed to shutdown QEMU.  You might need to 'killall qemu' or
             raise TerminateTest
 
     def __react(self, reactors, timeout):
-        deadline = time.time() + timeout
-        try:
-            while True:
-                timeleft = deadline - time.time()
-                if timeleft < 0:
-                    sys.stdout.write("Timeout! ")
-                    sys.stdout.flush()
-                    return
-
-                rset = [r for r in reactors if r.fileno() is not None]
-                if not rset:
-                    return
-
-                rset, _, _ = select.select(rset, [], [], timeleft)
-                for reactor in rset:
-                    reactor.handle_read()
-        except TerminateTest:
-            pass
+        react(reactors, timeout)
 
     def user_test(self, binary, *monitors, **kw):
         """Run a user test using the specified binary.  Monitors and
@@ -589,3 +597,269 @@ def stop_on_line(regexp):
     def stop(line):
         raise TerminateTest
     return call_on_line(regexp, stop)
+
+##################################################################
+# Boot-time benchmark
+#
+
+__all__ += ["boot_once", "run_bench"]
+
+BOOT_PHASE_RE = re.compile(r"boot-phase: (\S+) (\d+)")
+
+def boot_once(target_base="qemu", make_args=[], timeout=60):
+    """Boot JOS once with 'make <target_base>-nox' and time it.  Returns
+    a list of (phase, host seconds since QEMU's first line of output,
+    guest TSC) for each "boot-phase:" marker the kernel prints (see
+    boot_marker() in kern/tsc.c), ending with the first monitor prompt
+    as phase "K>", which has no guest TSC.  If the boot never got that
+    far, the list ends at the last marker it did print."""
+
+    start = None
+    qemu = QEMU(target_base + "-nox", *make_args)
+    phases = []
+    buf = bytearray()
+
+    def handle_output(output):
+        nonlocal start
+        now = time.time()
+        buf.extend(output)
+        while b"\n" in buf:
+            line, buf[:] = buf.split(b"\n", 1)
+            if start is None:
+                # make's "***" banner comes out before QEMU starts
+                if line.startswith(b"***"):
+                    continue
+                start = now
+            m = BOOT_PHASE_RE.search(line.decode("utf-8", "replace"))
+            if m:
+                phases.append((m.group(1), now - start, int(m.group(2))))
+        if b"K> " in buf and start is not None:
+            phases.append(("K>", now - start, None))
+            raise TerminateTest
+
+    qemu.on_output = [handle_output]
+    try:
+        react([qemu], timeout)
+    finally:
+        qemu.kill()
+        qemu.wait()
+    return phases
+
+def percentile(values, p):
+    """The p'th percentile of values, by the nearest-rank method."""
+    values = sorted(values)
+    rank = max(1, int(-(-len(values) * p // 100)))
+    return values[rank - 1]
+
+def run_bench():
+    """Boot JOS repeatedly through each requested loader and print, as
+    CSV, the median and 95th percentile time of every boot phase: host
+    wall clock in milliseconds, and guest TSC cycles where the kernel
+    reported them.  A phase's time runs from the previous marker; the
+    first host time runs from QEMU's first line of output, and the first
+    guest time from the guest TSC's reset.  Boots that stop short of the
+    monitor still count towards the phases they did reach."""
+
+    global options
+    parser = OptionParser(usage="usage: %prog bench [-n RUNS] [-t TARGET]... [-o CSV]")
+    parser.add_option("-v", "--verbose", action="store_true",
+                      help="print commands")
+    parser.add_option("-n", "--runs", type="int", default=10,
+                      help="boots per target (default 10)")
+    parser.add_option("-t", "--target", action="append", dest="targets",
+                      help="qemu (legacy boot) or qemu-uefi; repeatable "
+                      "(default both)")
+    parser.add_option("-o", "--output", help="write the CSV here instead of stdout")
+    parser.add_option("--make", action="append", type="string",
+                      dest="make_args", default=[], help="arguments to make command")
+    (options, args) = parser.parse_args()
+    options.color = "never"
+    targets = options.targets or ["qemu", "qemu-uefi"]
+
+    make(*options.make_args)
+    for target in targets:
+        if target == "qemu-uefi":
+            make("uefi-image", *options.make_args)
+
+    rows = []
+    for target in targets:
+        samples = {}
+        order = []
+        for i in range(options.runs):
+            phases = boot_once(target, options.make_args)
+            if not phases or phases[-1][0] != "K>":
+                print("%s: boot %d did not reach the monitor (last phase: %s)" %
+                      (target, i + 1, phases[-1][0] if phases else "none"),
+                      file=sys.stderr)
+            prev_host, prev_tsc = 0, 0
+            for name, host, tsc in phases:
+                if name not in samples:
+                    samples[name] = ([], [])
+                    order.append(name)
+                samples[name][0].append((host - prev_host) * 1000)
+                if tsc is not None:
+                    samples[name][1].append(tsc - prev_tsc)
+                    prev_tsc = tsc
+                prev_host = host
+        for name in order:
+            host, guest = samples[name]
+            rows.append([target, name, len(host),
+                         "%.3f" % percentile(host, 50), "%.3f" % percentile(host, 95),
+                         percentile(guest, 50) if guest else "",
+                         percentile(guest, 95) if guest else ""])
+
+    out = open(options.output, "w") if options.output else sys.stdout
+    out.write("target,phase,boots,host_ms_median,host_ms_p95,"
+              "guest_cycles_median,guest_cycles_p95\n")
+    for row in rows:
+        out.write(",".join(map(str, row)) + "\n")
+    if options.output:
+        out.close()
+
+##################################################################
+# Profile-guided optimization
+#
+
+__all__ += ["monitor_session", "run_pgo"]
+
+BENCH_RE = re.compile(r"bench: (\S+) (\d+) min=(\d+) median=(\d+)")
+
+def monitor_session(commands, make_args=[], timeout=300, target_base="qemu-uefi"):
+    """Boot JOS with 'make <target_base>-nox', type each of commands at a
+    monitor prompt in turn, and return everything the kernel printed once
+    the prompt comes back after the last one, or None if it never does.
+    The default is the UEFI boot: the legacy one ('qemu') hands the
+    kernel no memory map, so it has no pages to give the bench command
+    for its buffers."""
+
+    qemu = QEMU(target_base + "-nox", *make_args)
+    pending = list(commands)
+    done = []
+
+    def handle_output(output):
+        if qemu.outbytes.count(b"K> ") <= len(commands) - len(pending):
+            return
+        if not pending:
+            done.append(True)
+            raise TerminateTest
+        qemu.proc.stdin.write(pending.pop(0).encode() + b"\n")
+        qemu.proc.stdin.flush()
+
+    qemu.on_output = [handle_output]
+    try:
+        react([qemu], timeout)
+    finally:
+        qemu.kill()
+        qemu.wait()
+    return qemu.output if done else None
+
+def parse_bench(output):
+    """The (name, param) -> (min, median) cycles of each "bench:" line
+    in output (see kern/bench.c)."""
+    return dict(((m.group(1), int(m.group(2))),
+                 (int(m.group(3)), int(m.group(4))))
+                for m in BENCH_RE.finditer(output))
+
+def save_gcov(output):
+    """Write the .gcda files in a "gcov" dump (see kern/gcov.c) back to
+    where the kernel says they belong.  Returns how many were written."""
+    body = output.split("# BEGIN gcov\n", 1)[-1].split("# END gcov", 1)[0]
+    files = {}
+    name = None
+    for line in body.replace("\r", "").split("\n"):
+        if line.startswith("gcda "):
+            name = line[5:]
+            files[name] = bytearray()
+        elif name and line:
+            files[name].extend(bytearray.fromhex(line))
+    for name, data in files.items():
+        if name == "-":
+            continue
+        with open(name, "wb") as f:
+            f.write(data)
+    return len(files)
+
+def build_for(target_base, make_args):
+    """Build what 'make <target_base>-nox' boots, up front, so the build
+    isn't part of the session's timeout."""
+    make(*make_args)
+    if target_base == "qemu-uefi":
+        make("uefi-image", *make_args)
+
+def bench_kernel(label, target_base, make_args, names, runs):
+    """Run the monitor's bench command runs times on the kernel that
+    make_args build, and return (name, param) -> (best min, median of
+    medians)."""
+    build_for(target_base, make_args)
+    samples = {}
+    for i in range(runs):
+        output = monitor_session(["bench " + " ".join(names)], make_args,
+                                 target_base=target_base)
+        if output is None:
+            print("%s: run %d did not finish" % (label, i + 1), file=sys.stderr)
+            continue
+        for key, cycles in parse_bench(output).items():
+            samples.setdefault(key, []).append(cycles)
+    return dict((key, (min(c[0] for c in s), percentile([c[1] for c in s], 50)))
+                for key, s in samples.items())
+
+def run_pgo():
+    """Build the kernel three ways: as configured, with PGO=gen, and with
+    PGO=use on the profile that the PGO=gen kernel dumps after running
+    the monitor's bench suite.  Print, as CSV, each benchmark's cycles
+    on the plain and the PGO kernels and the change in the median."""
+
+    global options
+    parser = OptionParser(usage="usage: %prog pgo [-n RUNS] [-b BENCH]... [-t TARGET] [-o CSV]")
+    parser.add_option("-v", "--verbose", action="store_true",
+                      help="print commands")
+    parser.add_option("-n", "--runs", type="int", default=3,
+                      help="bench runs per kernel (default 3)")
+    parser.add_option("-b", "--bench", action="append", dest="names", default=[],
+                      help="benchmark to train and compare on (default all); repeatable")
+    parser.add_option("-t", "--target", default="qemu-uefi",
+                      help="boot through qemu-uefi (default) or qemu (legacy, "
+                      "which has no memory for the benchmarks)")
+    parser.add_option("-o", "--output", help="write the CSV here instead of stdout")
+    parser.add_option("--make", action="append", type="string",
+                      dest="make_args", default=[],
+                      help="arguments to make command, e.g. LTO=1")
+    (options, args) = parser.parse_args()
+    options.color = "never"
+    make_args = [a for a in options.make_args if not a.startswith("PGO=")]
+
+    target = options.target
+    base = bench_kernel("plain", target, make_args, options.names, options.runs)
+
+    gen_args = make_args + ["PGO=gen"]
+    build_for(target, gen_args)
+    output = monitor_session(["bench " + " ".join(options.names), "gcov"], gen_args,
+                             target_base=target)
+    if output is None or "# END gcov" not in output:
+        print("PGO=gen: no profile came back", file=sys.stderr)
+        sys.exit(1)
+    print("PGO=gen: %d profiles written" % save_gcov(output), file=sys.stderr)
+
+    pgo = bench_kernel("PGO=use", target, make_args + ["PGO=use"], options.names, options.runs)
+
+    out = open(options.output, "w") if options.output else sys.stdout
+    out.write("bench,param,base_min,pgo_min,base_median,pgo_median,median_delta_pct\n")
+    for key in sorted(base, key=lambda k: (k[0], k[1])):
+        if key not in pgo:
+            continue
+        (bmin, bmed), (pmin, pmed) = base[key], pgo[key]
+        delta = "%.1f" % (100.0 * (pmed - bmed) / bmed) if bmed else ""
+        out.write("%s,%d,%d,%d,%d,%d,%s\n" % (key[0], key[1], bmin, pmin, bmed, pmed, delta))
+    if options.output:
+        out.close()
+
+if __name__ == "__main__":
+    if sys.argv[1:2] == ["bench"]:
+        del sys.argv[1]
+        run_bench()
+    elif sys.argv[1:2] == ["pgo"]:
+        del sys.argv[1]
+        run_pgo()
+    else:
+        print("usage: %s bench|pgo [options]" % sys.argv[0], file=sys.stderr)
+        sys.exit(2)
@@ -64,6 +64,7 @@
 #define PTE_D		0x040	// Dirty
 #define PTE_PS		0x080	// Page Size
 #define PTE_G		0x100	// Global
+#define PTE_PS_PAT	0x1000	// PAT index bit of a 4MB page (PTE_PS set)
 
 // The PTE_AVAIL bits aren't used by the kernel or interpreted by the
 // hardware, so user processes are allowed to set them arbitrarily.
@@ -96,6 +97,19 @@
 #define CR4_PVI		0x00000002	// Protected-Mode Virtual Interrupts
 #define CR4_VME		0x00000001	// V86 Mode Extensions
 
+// CPUID leaf 1 EDX feature bits
+#define CPUID_PSE	0x00000008	// Page Size Extensions
+#define CPUID_PAT	0x00010000	// Page Attribute Table
+
+// CPUID leaf 0x80000007 EDX: the TSC runs at a constant rate in every
+// P-, C- and T-state
+#define CPUID_INVARIANT_TSC	0x00000100
+
+// Page Attribute Table MSR; a PTE's PWT, PCD and PAT bits index its
+// eight one-byte entries.
+#define MSR_PAT		0x277
+#define PAT_WC		0x01		// Write-Combining memory type
+
 // Eflags register
 #define FL_CF		0x00000001	// Carry Flag
 #define FL_PF		0x00000004	// Parity Flag
@@ -0,0 +1,64 @@
+#ifndef JOS_INC_PROBE_H
+#define JOS_INC_PROBE_H
+
+#include <inc/types.h>
+
+// Hot-path probes.
+//
+// PROBE() as the first statement of a function counts calls to it and
+// adds up the TSC cycles spent until the function returns, however it
+// returns.  Each site owns a struct Probe in the .probes section, which
+// the kernel monitor's "probes" command walks as an array; the explicit
+// alignment keeps gcc from padding the entries apart differently.
+//
+// Probes only exist in kernels built with CONFIG_PROBES=y; otherwise
+// PROBE() expands to nothing and costs nothing.  The counters are not
+// updated atomically, so concurrent callers may lose the odd sample.
+
+struct Probe {
+	const char *p_name;	// function containing the probe
+	const char *p_file;
+	int p_line;
+	uint64_t p_count;	// completed calls
+	uint64_t p_cycles;	// total TSC cycles across those calls
+	uint64_t p_max;		// longest single call, in cycles
+} __attribute__((aligned(64)));
+
+#if defined(CONFIG_PROBES) && defined(JOS_KERNEL)
+
+#include <inc/x86.h>
+
+struct ProbeScope {
+	struct Probe *ps_probe;
+	uint64_t ps_start;
+};
+
+static __inline void
+probe_exit(struct ProbeScope *ps)
+{
+	uint64_t t = read_tsc() - ps->ps_start;
+
+	ps->ps_probe->p_count++;
+	ps->ps_probe->p_cycles += t;
+	if (t > ps->ps_probe->p_max)
+		ps->ps_probe->p_max = t;
+}
+
+#define PROBE_PASTE2(a, b)	a##b
+#define PROBE_PASTE(a, b)	PROBE_PASTE2(a, b)
+
+#define PROBE()								\
+	static struct Probe PROBE_PASTE(__probe_, __LINE__)		\
+		__attribute__((section(".probes"), used)) =		\
+		{ __func__, __FILE__, __LINE__ };			\
+	struct ProbeScope PROBE_PASTE(__probe_scope_, __LINE__)		\
+		__attribute__((cleanup(probe_exit))) =			\
+		{ &PROBE_PASTE(__probe_, __LINE__), read_tsc() }
+
+#else
+
+#define PROBE()		do { } while (0)
+
+#endif
+
+#endif /* !JOS_INC_PROBE_H */
@@ -341,6 +341,65 @@ typedef struct {
   void                              *VendorTable;
 } EFI_CONFIGURATION_TABLE;
 
+// Boot phase timing, filled in by the loader and appended to by the
+// kernel.  Must match JosPkg/Application/Loader/Bootloader.h.
+#define BOOT_TIMING_VERSION     1
+#define BOOT_TIMING_MAX_STAMPS  16
+
+#define BOOT_STAMP_LOADER_ENTRY   0  // UefiMain() entered
+#define BOOT_STAMP_GOP_START      1  // About to set up graphics
+#define BOOT_STAMP_GOP_DONE       2  // Graphics set up
+#define BOOT_STAMP_CONFIG_PARSED  3  // Kernel64.txt read and parsed
+#define BOOT_STAMP_LOAD_START     4  // Kernel file opened
+#define BOOT_STAMP_LOAD_DONE      5  // Kernel segments in memory
+#define BOOT_STAMP_EXIT_BOOT      6  // About to exit boot services
+#define BOOT_STAMP_KERNEL_JUMP    7  // Jumping to the kernel
+#define BOOT_STAMP_KERNEL_ENTRY   8  // i386_init() entered
+#define BOOT_STAMP_CONSOLE        9  // cons_init() done
+#define BOOT_STAMP_MEMORY_MAP     10 // init_memory_map() done
+#define BOOT_STAMP_TRAPS          11 // trap_init() and pic_init() done
+
+typedef struct {
+  uint32_t                  Id;                             // One of the BOOT_STAMP_* values above
+  uint32_t                  Reserved;
+  ALIGNEDU64                Tsc;                            // Time stamp counter when the phase ended
+} BOOT_STAMP;
+
+typedef struct {
+  uint32_t                  Version;                        // BOOT_TIMING_VERSION
+  uint32_t                  Count;                          // The number of valid entries in Stamps
+  ALIGNEDU64                TscPerMs;                       // The loader's Stall()-based calibration, or 0
+  BOOT_STAMP                Stamps[BOOT_TIMING_MAX_STAMPS];
+} BOOT_TIMING;
+
+// The loader's coalesced memory map: sorted by address, neighbouring
+// ranges of the same type merged.  Must match Bootloader.h.
+#define MEMORY_RANGE_RECLAIMABLE  0x1        // Boot services code/data, free once we're done with it
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      PhysicalStart;                  // Page-aligned start of the range
+  ALIGNEDU64                NumberOfPages;                  // Its length in 4 KiB pages
+  uint32_t                  Type;                           // EFI_MEMORY_TYPE
+  uint32_t                  Flags;                          // MEMORY_RANGE_* flags
+} MEMORY_RANGE;
+
+// The loader's initial page directory maps RAM and framebuffers at
+// their physical addresses with 4MB pages, plus the first 256MB again
+// at LOADER_HIGH_HALF_BASE where that doesn't collide.  Framebuffer
+// entries set PTE_PS_PAT (PAT entry 4).  Must match Bootloader.h.
+#define LOADER_HIGH_HALF_BASE     0xF0000000
+
+// Boot modules: files listed after the command line in Kernel64.txt,
+// each in its own page-aligned loader pages.  Must match Bootloader.h.
+#define BOOT_MODULE_NAME_LEN      48
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      Base;                           // Page-aligned start of the module's data (0 if empty)
+  ALIGNEDU64                Size;                           // Its length in bytes; the rest of the last page is zero
+  ALIGNEDU64                Pages;                          // The number of 4 KiB pages allocated for it
+  char                      Name[BOOT_MODULE_NAME_LEN];     // The file name without its directory
+} BOOT_MODULE;
+
 typedef struct {
   uint32_t                    UEFI_Version;                   // The system UEFI version
   uint32_t                    Bootloader_MajorVersion;        // The major version of the bootloader
@@ -368,8 +427,34 @@ typedef struct {
   EFI_FILE_INFO            *FileMeta;                       // Kernel file metadata
   EFI_CONFIGURATION_TABLE  *ConfigTables;                   // UEFI-installed system configuration tables (ACPI, SMBIOS, etc.)
   UINTN                     Number_of_ConfigTables;         // The number of system configuration tables
+
+  BOOT_TIMING               Boot_Timing;                    // TSC stamps of each boot phase so far
+
+  MEMORY_RANGE             *Memory_Ranges;                  // The coalesced memory map
+  UINTN                     Number_of_Memory_Ranges;        // The number of entries in it (0 if the loader couldn't build it)
+
+  EFI_PHYSICAL_ADDRESS      Page_Directory;                 // Initial 4MB-page directory for CR3 (0 if there isn't one)
+
+  BOOT_MODULE              *Modules;                        // Boot modules from Kernel64.txt
+  UINTN                     Number_of_Modules;              // The number of entries in it
 } LOADER_PARAMS;
 
+// Loaders before 2.3 end LOADER_PARAMS at Number_of_ConfigTables, and
+// every later minor version appends fields.  Check LOADER_PARAMS_HAS()
+// with the version that introduced a field before reading it; a NULL
+// block (the legacy boot loader's) has none of them.  Must match
+// MAJOR_VER/MINOR_VER in JosPkg/Application/Loader/Bootloader.h.
+#define LOADER_VERSION(major, minor)  ((uint32_t)(major) << 16 | (minor))
+#define LOADER_PARAMS_VERSION(lp)                                       \
+  LOADER_VERSION((lp)->Bootloader_MajorVersion, (lp)->Bootloader_MinorVersion)
+#define LOADER_PARAMS_HAS(lp, since)                                    \
+  ((lp) && LOADER_PARAMS_VERSION(lp) >= (since))
+
+#define LOADER_BOOT_TIMING      LOADER_VERSION(2, 3)  // Boot_Timing
+#define LOADER_MEMORY_RANGES    LOADER_VERSION(2, 4)  // Memory_Ranges
+#define LOADER_PAGE_DIRECTORY   LOADER_VERSION(2, 5)  // Page_Directory
+#define LOADER_MODULES          LOADER_VERSION(2, 6)  // Modules
+
 extern LOADER_PARAMS* UEFI_LP;
 
 #endif //JOS_INC_UEFI_H
@@ -0,0 +1,96 @@
+/* See COPYRIGHT for copyright information. */
+
+// ACPI table lookup.
+//
+// The UEFI loader passes the firmware's configuration tables, one of
+// which points to the ACPI RSDP.  From there the XSDT (or, for ACPI
+// 1.0, the RSDT) lists every other table by physical address; the
+// loader's page directory maps the ACPI memory where it is, so the
+// tables can be read in place.
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/uefi.h>
+
+#include <kern/acpi.h>
+
+static const EFI_GUID acpi20_guid =
+	{ 0x8868e871, 0xe4f1, 0x11d3, { 0xbc, 0x22, 0x00, 0x80, 0xc7, 0x3c, 0x88, 0x81 } };
+static const EFI_GUID acpi10_guid =
+	{ 0xeb9d2d30, 0x2d88, 0x11d3, { 0x9a, 0x16, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d } };
+
+static uint8_t
+acpi_checksum(const void *p, size_t n)
+{
+	const uint8_t *b = p;
+	uint8_t sum = 0;
+
+	while (n-- > 0)
+		sum += *b++;
+	return sum;
+}
+
+// The RSDP, preferring the ACPI 2.0 entry, or NULL if the firmware
+// passed none that checks out.
+static struct AcpiRsdp *
+acpi_rsdp(void)
+{
+	EFI_CONFIGURATION_TABLE *ct;
+	struct AcpiRsdp *rsdp, *found = NULL;
+	UINTN i;
+
+	if (!UEFI_LP || !UEFI_LP->ConfigTables)
+		return NULL;
+	for (i = 0; i < UEFI_LP->Number_of_ConfigTables; i++) {
+		ct = &UEFI_LP->ConfigTables[i];
+		rsdp = ct->VendorTable;
+		if (memcmp(&ct->VendorGuid, &acpi20_guid, sizeof(EFI_GUID)) != 0 &&
+		    memcmp(&ct->VendorGuid, &acpi10_guid, sizeof(EFI_GUID)) != 0)
+			continue;
+		if (memcmp(rsdp->sig, "RSD PTR ", 8) != 0 ||
+		    acpi_checksum(rsdp, 20) != 0)
+			continue;
+		if (rsdp->revision >= 2 && rsdp->xsdt &&
+		    acpi_checksum(rsdp, rsdp->length) == 0)
+			return rsdp;
+		found = rsdp;
+	}
+	return found;
+}
+
+// Find the table with signature 'sig' (e.g. "FACP" or "APIC") and a
+// good checksum.  Returns NULL if there is none.
+void *
+acpi_find_table(const char *sig)
+{
+	struct AcpiRsdp *rsdp;
+	struct AcpiSdtHeader *root, *h;
+	uint32_t i, n, esize;
+	uint64_t pa;
+
+	if (!(rsdp = acpi_rsdp()))
+		return NULL;
+	// Tables above 4GB are out of our reach
+	if (rsdp->revision >= 2 && rsdp->xsdt && rsdp->xsdt < 0x100000000ULL) {
+		root = (struct AcpiSdtHeader *) (uint32_t) rsdp->xsdt;
+		esize = 8;
+	} else {
+		root = (struct AcpiSdtHeader *) rsdp->rsdt;
+		esize = 4;
+	}
+	if (!root || acpi_checksum(root, root->length) != 0)
+		return NULL;
+
+	n = (root->length - sizeof(*root)) / esize;
+	for (i = 0; i < n; i++) {
+		pa = 0;
+		memcpy(&pa, (char *) (root + 1) + i * esize, esize);
+		if (!pa || pa >= 0x100000000ULL)
+			continue;
+		h = (struct AcpiSdtHeader *) (uint32_t) pa;
+		if (memcmp(h->sig, sig, 4) == 0 &&
+		    acpi_checksum(h, h->length) == 0)
+			return h;
+	}
+	return NULL;
+}
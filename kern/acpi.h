@@ -0,0 +1,116 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_ACPI_H
+#define JOS_KERN_ACPI_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Root System Description Pointer, found through the UEFI
+// configuration tables
+struct AcpiRsdp {
+	char sig[8];		// "RSD PTR "
+	uint8_t checksum;	// of the first 20 bytes
+	char oem_id[6];
+	uint8_t revision;	// 0 for ACPI 1.0, 2 for 2.0 and later
+	uint32_t rsdt;
+	// ACPI 2.0 and later
+	uint32_t length;
+	uint64_t xsdt;
+	uint8_t xchecksum;	// of the whole structure
+	uint8_t reserved[3];
+} __attribute__((packed));
+
+// Header common to every system description table
+struct AcpiSdtHeader {
+	char sig[4];
+	uint32_t length;	// including this header
+	uint8_t revision;
+	uint8_t checksum;	// of the whole table
+	char oem_id[6];
+	char oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} __attribute__((packed));
+
+// Fixed ACPI Description Table ("FACP"), as far as we use it
+struct AcpiFadt {
+	struct AcpiSdtHeader h;
+	uint32_t firmware_ctrl;
+	uint32_t dsdt;
+	uint8_t reserved0;
+	uint8_t preferred_pm_profile;
+	uint16_t sci_int;
+	uint32_t smi_cmd;
+	uint8_t acpi_enable;
+	uint8_t acpi_disable;
+	uint8_t s4bios_req;
+	uint8_t pstate_cnt;
+	uint32_t pm1a_evt_blk;
+	uint32_t pm1b_evt_blk;
+	uint32_t pm1a_cnt_blk;
+	uint32_t pm1b_cnt_blk;
+	uint32_t pm2_cnt_blk;
+	uint32_t pm_tmr_blk;	// I/O port of the PM timer, or 0
+	uint32_t gpe0_blk;
+	uint32_t gpe1_blk;
+	uint8_t pm1_evt_len;
+	uint8_t pm1_cnt_len;
+	uint8_t pm2_cnt_len;
+	uint8_t pm_tmr_len;	// 4 if there is a PM timer
+	uint8_t gpe0_blk_len;
+	uint8_t gpe1_blk_len;
+	uint8_t gpe1_base;
+	uint8_t cst_cnt;
+	uint16_t p_lvl2_lat;
+	uint16_t p_lvl3_lat;
+	uint16_t flush_size;
+	uint16_t flush_stride;
+	uint8_t duty_offset;
+	uint8_t duty_width;
+	uint8_t day_alrm;
+	uint8_t mon_alrm;
+	uint8_t century;
+	uint16_t iapc_boot_arch;
+	uint8_t reserved1;
+	uint32_t flags;
+} __attribute__((packed));
+
+#define ACPI_FADT_TMR_VAL_EXT	0x00000100	// PM timer is 32 bits, not 24
+
+#define ACPI_PM_FREQ		3579545		// PM timer rate, Hz
+
+// Multiple APIC Description Table ("APIC").  Variable-length entries,
+// each starting with a type and length byte, follow the header.
+struct AcpiMadt {
+	struct AcpiSdtHeader h;
+	uint32_t lapic_addr;	// physical address of the local APICs
+	uint32_t flags;
+} __attribute__((packed));
+
+#define ACPI_MADT_LAPIC		0	// processor local APIC
+#define ACPI_MADT_LAPIC_ADDR	5	// 64-bit local APIC address override
+
+struct AcpiMadtLapic {
+	uint8_t type;
+	uint8_t length;
+	uint8_t processor_id;
+	uint8_t apic_id;
+	uint32_t flags;
+} __attribute__((packed));
+
+#define ACPI_MADT_ENABLED	0x00000001	// processor can be started
+
+struct AcpiMadtLapicAddr {
+	uint8_t type;
+	uint8_t length;
+	uint16_t reserved;
+	uint64_t lapic_addr;
+} __attribute__((packed));
+
+void *acpi_find_table(const char *sig);
+
+#endif	// !JOS_KERN_ACPI_H
@@ -0,0 +1,374 @@
+/* See COPYRIGHT for copyright information. */
+
+// In-kernel microbenchmarks, run from the monitor's "bench" command.
+//
+// Each benchmark is a function of one parameter (a size, a count, ...)
+// swept over a few values.  For every value it is run BENCH_WARMUP
+// times untimed, then BENCH_SAMPLES times between serialized TSC
+// reads, and the minimum and median are printed, in cycles and in
+// nanoseconds, as
+//
+//	bench: <name> <param> min=<cycles> median=<cycles> min_ns=<ns> median_ns=<ns>
+//
+// one line each, which goes to serial as well as the screen so a host
+// script can collect it.  "null" times an empty call, i.e. the cost of
+// the measurement itself; the others are not corrected for it.
+//
+// "pcache" and "pglobal" run the same page allocation churn on n CPUs
+// at once, through the per-CPU page caches and straight through
+// AllocatePages() respectively, so with perfect scaling the time stays
+// flat as n grows.  Boot with CPUS=<n> (make qemu-uefi) to have the
+// CPUs; a count beyond those running is reported as skipped.
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/mmu.h>
+#include <inc/x86.h>
+#include <inc/uefi.h>
+
+#include <kern/bench.h>
+#include <kern/console.h>
+#include <kern/cpu.h>
+#include <kern/pagecache.h>
+#include <kern/kdebug.h>
+#include <kern/uefi_f.h>
+#include <kern/tsc.h>
+
+struct Bench {
+	const char *name;
+	const char *desc;
+	void (*fn)(uint32_t arg);
+	const uint32_t *args;	// parameter values swept
+	int nargs;
+};
+
+// Scratch buffers for the memory benchmarks, BENCH_BUFSIZE each.
+static char *bench_src, *bench_dst;
+
+// Set by a benchmark that could not do its work; the result is
+// reported as failed instead of timed.
+static int bench_failed;
+
+// Set by a benchmark whose parameter doesn't apply to this machine.
+static int bench_skipped;
+
+// cpuid waits for every earlier instruction to finish, so nothing
+// being measured can drift past the TSC read in either direction.
+static uint64_t
+bench_tsc(void)
+{
+	cpuid(0, NULL, NULL, NULL, NULL);
+	return read_tsc();
+}
+
+static void
+bench_null(uint32_t arg)
+{
+}
+
+static void
+bench_memset(uint32_t n)
+{
+	memset(bench_dst, n, n);
+}
+
+static void
+bench_memcpy(uint32_t n)
+{
+	memcpy(bench_dst, bench_src, n);
+}
+
+static void
+bench_memmove(uint32_t n)
+{
+	memmove(bench_dst, bench_src, n);
+}
+
+static void
+null_putch(int ch, void *cnt)
+{
+	(*(int *) cnt)++;
+}
+
+static void __attribute__((format(printf, 1, 2)))
+null_printf(const char *fmt, ...)
+{
+	va_list ap;
+	int cnt = 0;
+
+	va_start(ap, fmt);
+	vprintfmt(null_putch, &cnt, fmt, ap);
+	va_end(ap);
+}
+
+// n lines of the sort of thing the kernel prints, formatted into
+// nothing, so only vprintfmt is timed.
+static void
+bench_printf(uint32_t n)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++)
+		null_printf("%s %d 0x%08x %llu %-8s|%c\n",
+			    "bench", -(int) i, i, (uint64_t) i << 20, "pad", 'x');
+}
+
+// n characters along the top text line, drawn black on black.
+static void
+bench_drawchar(uint32_t n)
+{
+	uint32_t *fb = cga_framebuffer();
+	uint32_t i;
+
+	if (!fb) {
+		bench_failed = 1;
+		return;
+	}
+	for (i = 0; i < n; i++)
+		drawChar(fb, i % 64, 0, 0, 'A' + i % 26);
+}
+
+// One full-screen scroll: the memmove of the framebuffer and the
+// clearing of the bottom line that cga_putc does at every wrap.
+static void
+bench_scroll(uint32_t n)
+{
+	if (!cga_framebuffer()) {
+		bench_failed = 1;
+		return;
+	}
+	cga_scroll();
+}
+
+// Allocate n pages and give them back.
+static void
+bench_pages(uint32_t n)
+{
+	EFI_PHYSICAL_ADDRESS a;
+
+	if (AllocatePages(AllocateAnyPages, EfiLoaderData, n, &a) != EFI_SUCCESS) {
+		bench_failed = 1;
+		return;
+	}
+	FreePages(&a, n);
+}
+
+#define PAGEMIX_MAX	64
+
+// n allocations of assorted sizes, then every other one freed, then
+// the rest, so frees land both next to free runs and between
+// allocated ones.
+static void
+bench_pagemix(uint32_t n)
+{
+	static const UINTN sizes[] = { 1, 2, 1, 4, 1, 8, 3, 1 };
+	EFI_PHYSICAL_ADDRESS a[PAGEMIX_MAX];
+	uint32_t i, got;
+
+	for (got = 0; got < n && got < PAGEMIX_MAX; got++)
+		if (AllocatePages(AllocateAnyPages, EfiLoaderData,
+				  sizes[got % 8], &a[got]) != EFI_SUCCESS) {
+			bench_failed = 1;
+			break;
+		}
+	for (i = 0; i < got; i += 2)
+		FreePages(&a[i], sizes[i % 8]);
+	for (i = 1; i < got; i += 2)
+		FreePages(&a[i], sizes[i % 8]);
+}
+
+// One debuginfo_eip lookup, of the next of n addresses spread over the
+// kernel.  debuginfo_eip remembers its last answers in a small
+// direct-mapped cache (DEBUGINFO_CACHE_SIZE, 64 entries), so n = 1 times
+// a cache hit, and cycling through n = 256 times (nearly always) a miss
+// and the binary search of the symbol index behind it.
+static void
+bench_debuginfo(uint32_t n)
+{
+	static uint32_t next;
+	struct Eipdebuginfo info;
+	uintptr_t eip = debuginfo_sample_eip(next++, n);
+
+	// Not every address is in a function; the lookup costs the same.
+	if (eip)
+		debuginfo_eip(eip, &info);
+	else
+		bench_failed = 1;
+}
+
+// Run fn(arg) on n CPUs at once, this one and n - 1 running APs, and
+// wait until all of them are done.
+static void
+bench_smp(uint32_t n, void (*fn)(void *), void *arg)
+{
+	struct CpuInfo *c, *called[NCPU];
+	uint32_t i, ncalled = 0, online = 0;
+
+	for (c = cpus; c < cpus + ncpu; c++)
+		if (c->cpu_status == CPU_STARTED)
+			online++;
+	if (n > online) {
+		bench_skipped = 1;
+		return;
+	}
+	for (c = cpus; c < cpus + ncpu && ncalled + 1 < n; c++)
+		if (cpu_call(c, fn, arg) == 0)
+			called[ncalled++] = c;
+	fn(arg);
+	for (i = 0; i < ncalled; i++)
+		cpu_call_wait(called[i]);
+}
+
+#define CHURN_ROUNDS	256
+#define CHURN_DEPTH	8
+
+// A way to allocate and free single pages, for churn().
+struct PageOps {
+	int (*alloc)(EFI_PHYSICAL_ADDRESS *pa);	// 0 on success
+	void (*free)(EFI_PHYSICAL_ADDRESS pa);
+};
+
+static int
+global_alloc(EFI_PHYSICAL_ADDRESS *pa)
+{
+	return AllocatePages(AllocateAnyPages, EfiLoaderData, 1, pa) == EFI_SUCCESS ? 0 : -1;
+}
+
+static void
+global_free(EFI_PHYSICAL_ADDRESS pa)
+{
+	FreePages(&pa, 1);
+}
+
+static const struct PageOps pcache_ops = { page_alloc, page_free };
+static const struct PageOps global_ops = { global_alloc, global_free };
+
+// CHURN_ROUNDS times, allocate CHURN_DEPTH single pages with the
+// PageOps in arg and free them.
+static void
+churn(void *arg)
+{
+	const struct PageOps *ops = arg;
+	EFI_PHYSICAL_ADDRESS a[CHURN_DEPTH];
+	int i, j;
+
+	for (i = 0; i < CHURN_ROUNDS; i++) {
+		for (j = 0; j < CHURN_DEPTH; j++)
+			if (ops->alloc(&a[j]) < 0) {
+				bench_failed = 1;
+				break;
+			}
+		while (--j >= 0)
+			ops->free(a[j]);
+	}
+}
+
+static void
+bench_pcache(uint32_t n)
+{
+	bench_smp(n, churn, (void *) &pcache_ops);
+}
+
+static void
+bench_pglobal(uint32_t n)
+{
+	bench_smp(n, churn, (void *) &global_ops);
+}
+
+static const uint32_t args_one[] = { 1 };
+static const uint32_t args_size[] = { 16, 256, 4096, 65536, BENCH_BUFSIZE };
+static const uint32_t args_printf[] = { 1, 16 };
+static const uint32_t args_chars[] = { 1, 64 };
+static const uint32_t args_pages[] = { 1, 16, 256 };
+static const uint32_t args_pagemix[] = { 8, PAGEMIX_MAX };
+static const uint32_t args_eips[] = { 1, 256 };
+static const uint32_t args_cpus[] = { 1, 2, 4, 8 };
+
+#define SWEEP(a)	a, sizeof(a) / sizeof(a[0])
+
+static const struct Bench benches[] = {
+	{ "null", "empty call: measurement overhead", bench_null, SWEEP(args_one) },
+	{ "memset", "memset of n bytes", bench_memset, SWEEP(args_size) },
+	{ "memcpy", "memcpy of n bytes", bench_memcpy, SWEEP(args_size) },
+	{ "memmove", "memmove of n bytes, no overlap", bench_memmove, SWEEP(args_size) },
+	{ "printf", "vprintfmt of n lines to a null sink", bench_printf, SWEEP(args_printf) },
+	{ "drawchar", "drawChar of n characters", bench_drawchar, SWEEP(args_chars) },
+	{ "scroll", "full-screen framebuffer scroll", bench_scroll, SWEEP(args_one) },
+	{ "pages", "AllocatePages + FreePages of n pages", bench_pages, SWEEP(args_pages) },
+	{ "pagemix", "n mixed-size allocations, frees interleaved", bench_pagemix, SWEEP(args_pagemix) },
+	{ "debuginfo", "debuginfo_eip cycling through n addresses", bench_debuginfo, SWEEP(args_eips) },
+	{ "pcache", "page_alloc/page_free churn on n CPUs at once", bench_pcache, SWEEP(args_cpus) },
+	{ "pglobal", "the same churn through AllocatePages/FreePages", bench_pglobal, SWEEP(args_cpus) },
+};
+
+#define NBENCHES	(sizeof(benches) / sizeof(benches[0]))
+
+static void
+bench_one(const struct Bench *b, uint32_t arg)
+{
+	uint64_t t[BENCH_SAMPLES], start, v;
+	int i, j;
+
+	bench_failed = bench_skipped = 0;
+	for (i = 0; i < BENCH_WARMUP; i++)
+		b->fn(arg);
+	for (i = 0; i < BENCH_SAMPLES && !bench_failed && !bench_skipped; i++) {
+		start = bench_tsc();
+		b->fn(arg);
+		v = bench_tsc() - start;
+		for (j = i; j > 0 && t[j - 1] > v; j--)
+			t[j] = t[j - 1];
+		t[j] = v;
+	}
+
+	if (bench_skipped)
+		cprintf("bench: %s %u skipped\n", b->name, arg);
+	else if (bench_failed)
+		cprintf("bench: %s %u failed\n", b->name, arg);
+	else
+		cprintf("bench: %s %u min=%llu median=%llu min_ns=%llu median_ns=%llu\n",
+			b->name, arg, t[0], t[BENCH_SAMPLES / 2],
+			tsc_to_ns(t[0]), tsc_to_ns(t[BENCH_SAMPLES / 2]));
+}
+
+void
+bench_list(void)
+{
+	size_t i;
+
+	for (i = 0; i < NBENCHES; i++)
+		cprintf("%-10s %s\n", benches[i].name, benches[i].desc);
+}
+
+// Run the benchmark called 'name', or all of them if name is NULL.
+// Returns the number run, or -1 if the scratch buffers can't be had.
+int
+bench_run(const char *name)
+{
+	EFI_PHYSICAL_ADDRESS src, dst;
+	UINTN pages = BENCH_BUFSIZE / PGSIZE;
+	size_t i;
+	int j, n = 0;
+
+	if (AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &src) != EFI_SUCCESS)
+		return -1;
+	if (AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &dst) != EFI_SUCCESS) {
+		FreePages(&src, pages);
+		return -1;
+	}
+	bench_src = (char *) (uint32_t) src;
+	bench_dst = (char *) (uint32_t) dst;
+	memset(bench_src, 0xA5, BENCH_BUFSIZE);
+
+	for (i = 0; i < NBENCHES; i++) {
+		if (name && strcmp(name, benches[i].name) != 0)
+			continue;
+		for (j = 0; j < benches[i].nargs; j++)
+			bench_one(&benches[i], benches[i].args[j]);
+		n++;
+	}
+
+	FreePages(&dst, pages);
+	FreePages(&src, pages);
+	return n;
+}
@@ -0,0 +1,18 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_BENCH_H
+#define JOS_KERN_BENCH_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+#define BENCH_WARMUP		3	// untimed runs before sampling
+#define BENCH_SAMPLES		31	// timed runs; min and median reported
+#define BENCH_BUFSIZE		(1 << 20) // largest memory op swept
+
+void bench_list(void);
+int bench_run(const char *name);
+
+#endif	// !JOS_KERN_BENCH_H
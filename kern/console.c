@@ -5,6 +5,7 @@
 #include <inc/kbdreg.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/probe.h>
 
 #include <kern/console.h>
 
@@ -186,6 +187,7 @@ static char font8x8_basic[128][8] = {
 
 void drawChar(uint32_t *buffer, uint32_t x, uint32_t y, uint32_t color, char charcode)
 {
+    PROBE();
     assert(charcode < 128);
     int pos = charcode;
     char *p = &(font8x8_basic[pos][0]); // Size of a font's character
@@ -215,9 +217,10 @@ serial_intr(void)
 		cons_intr(serial_proc_data);
 }
 
-static void
+void
 serial_putc(int c)
 {
+	PROBE();
 	int i;
 
 	for (i = 0;
@@ -282,6 +285,26 @@ static unsigned addr_6845;
 static uint32_t *crt_buf;
 static uint16_t crt_pos;
 
+// The framebuffer the console draws into, or NULL before cons_init()
+// and on a legacy boot, which has none.
+uint32_t *
+cga_framebuffer(void)
+{
+	return crt_buf;
+}
+
+// Move the whole screen up one text line and blank the bottom line.
+// Leaves the cursor alone.
+void
+cga_scroll(void)
+{
+	int i;
+
+	memmove(crt_buf, crt_buf + uefi_hres*SYMBOL_SIZE, uefi_hres * (uefi_vres - SYMBOL_SIZE) * sizeof(uint32_t));
+	for (i = uefi_hres * (uefi_vres - (uefi_vres % SYMBOL_SIZE) - SYMBOL_SIZE); i < uefi_hres * uefi_vres; i++)
+		crt_buf[i] = 0;
+}
+
 static void
 cga_init(void)
 {
@@ -306,6 +329,10 @@ cga_init(void)
 	outb(addr_6845, 15);
 	pos |= inb(addr_6845 + 1);
 
+	// The legacy boot loader hands us no framebuffer; keep to the
+	// serial and parallel ports then.
+	if (!UEFI_LP)
+		return;
 
 	uint64_t fbbase = UEFI_LP->GPU_Configs[0].GPUArray[0].FrameBufferBase;
 	crt_buf = (uint32_t*)(uint32_t)(fbbase & 0xffffffff);
@@ -325,6 +352,11 @@ cga_init(void)
 static void
 cga_putc(int c)
 {
+	PROBE();
+
+	if (!crt_buf)
+		return;
+
 	// if no attribute given, then use black on white
 	if (!(c & ~0xFF))
 		c |= 0x0700;
@@ -359,11 +391,7 @@ cga_putc(int c)
 
 	// What is the purpose of this?
 	if (crt_pos >= crt_size) {
-		int i;
-
-		memmove(crt_buf, crt_buf + uefi_hres*SYMBOL_SIZE, uefi_hres * (uefi_vres - SYMBOL_SIZE) * sizeof(uint32_t));
-		for (i = uefi_hres * (uefi_vres - (uefi_vres % SYMBOL_SIZE) - SYMBOL_SIZE); i < uefi_hres * uefi_vres; i++)
-			crt_buf[i] = 0;
+		cga_scroll();
 		crt_pos -= crt_cols;
 	}
 
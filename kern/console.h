@@ -20,5 +20,11 @@ int cons_getc(void);
 
 void kbd_intr(void); // irq 1
 void serial_intr(void); // irq 4
+void serial_putc(int c); // bypasses the screen, e.g. for bulk dumps
+
+// Framebuffer text drawing, exposed for kern/bench.c
+void drawChar(uint32_t *buffer, uint32_t x, uint32_t y, uint32_t color, char charcode);
+uint32_t *cga_framebuffer(void);
+void cga_scroll(void);
 
 #endif /* _CONSOLE_H_ */
@@ -0,0 +1,60 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_CPU_H
+#define JOS_KERN_CPU_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+#include <inc/mmu.h>
+
+// Maximum number of CPUs
+#define NCPU			8
+
+// The AP startup code is copied to a free page below this, since a
+// startup IPI can only name a real-mode page.
+#define MPENTRY_MAX		0xA0000
+
+#define AP_START_TIMEOUT_MS	100	// wait for each AP before giving up
+
+// Values of status in struct CpuInfo
+enum {
+	CPU_UNUSED = 0,
+	CPU_STARTED,
+	CPU_FAILED,
+};
+
+// Per-CPU state
+struct CpuInfo {
+	uint8_t cpu_id;			// Index into cpus[] below
+	uint8_t cpu_apicid;		// Local APIC ID
+	volatile unsigned cpu_status;	// The status of the CPU
+	uint64_t cpu_boot_ns;		// INIT IPI to running mp_main, APs only
+	void (*volatile cpu_call)(void *); // Work for the idle loop, see cpu_call()
+	void *volatile cpu_call_arg;
+};
+
+// Initialized in mpconfig.c
+extern struct CpuInfo cpus[NCPU];
+extern int ncpu;			// Total number of CPUs in the system
+extern struct CpuInfo *bootcpu;		// The boot-strap processor (BSP)
+extern physaddr_t lapicaddr;		// Physical MMIO address of the local APIC
+
+// Per-CPU kernel stacks
+extern unsigned char percpu_kstacks[NCPU][KSTKSIZE];
+
+int cpunum(void);
+#define thiscpu (&cpus[cpunum()])
+
+void mp_init(void);
+void lapic_init(void);
+void lapic_startap(uint8_t apicid, uint32_t addr);
+void lapic_eoi(void);
+void lapic_ipi(uint8_t apicid, int vector);
+
+int cpu_call(struct CpuInfo *c, void (*fn)(void *), void *arg);
+void cpu_call_wait(struct CpuInfo *c);
+
+#endif	// !JOS_KERN_CPU_H
@@ -0,0 +1,146 @@
+/* See COPYRIGHT for copyright information. */
+
+// Arc counter dump for kernels built with 'make PGO=gen'.
+//
+// Such a kernel is compiled with -fprofile-arcs -fprofile-info-section,
+// so instead of registering with a gcov runtime at startup, each
+// object's counters hang off a struct gcov_info that the compiler
+// points to from the .gcov_info section.  gcov_dump() has libgcov's
+// __gcov_info_to_gcda() turn each into the contents of a .gcda file and
+// writes them to the serial port as
+//
+//	# BEGIN gcov
+//	gcda <path of the .gcda file>
+//	<contents, in hex, 64 bytes per line>
+//	...
+//	# END gcov
+//
+// "gradelib.py pgo" writes the files back where they came from, next
+// to the objects, which is where 'make PGO=use' looks for them.
+
+#include <inc/stdio.h>
+
+#include <kern/gcov.h>
+#include <kern/console.h>
+
+#ifdef CONFIG_PGO_GEN
+
+#include <inc/assert.h>
+
+struct gcov_info;
+
+extern const struct gcov_info *const __gcov_info_start[];
+extern const struct gcov_info *const __gcov_info_end[];
+
+void __gcov_info_to_gcda(const struct gcov_info *info,
+			 void (*filename_fn)(const char *, void *),
+			 void (*dump_fn)(const void *, unsigned, void *),
+			 void *(*allocate_fn)(unsigned, void *),
+			 void *arg);
+
+// What one object's dump has written and allocated so far.
+struct GcovDump {
+	uint32_t col;
+	uint32_t used;
+};
+
+static char gcov_arena[GCOV_ARENA_SIZE] __attribute__((aligned(8)));
+
+static void
+gcov_putch(int ch, void *unused)
+{
+	serial_putc(ch);
+}
+
+static void
+gcov_filename(const char *name, void *arg)
+{
+	printfmt(gcov_putch, NULL, "gcda %s\n", name ? name : "-");
+}
+
+static void
+gcov_data(const void *data, unsigned n, void *arg)
+{
+	struct GcovDump *d = arg;
+	const uint8_t *p = data;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		printfmt(gcov_putch, NULL, "%02x", p[i]);
+		if (++d->col == 64) {
+			serial_putc('\n');
+			d->col = 0;
+		}
+	}
+}
+
+// Only value-profile counters need memory, and PGO=gen doesn't ask
+// for those, so a small arena per object is plenty.
+static void *
+gcov_allocate(unsigned n, void *arg)
+{
+	struct GcovDump *d = arg;
+	void *p;
+
+	n = ROUNDUP(n, 8);
+	if (d->used + n > GCOV_ARENA_SIZE)
+		return NULL;
+	p = gcov_arena + d->used;
+	d->used += n;
+	return p;
+}
+
+// Write every object's counters to serial.  Returns the number of
+// objects dumped, or -1 if this kernel isn't instrumented.
+int
+gcov_dump(void)
+{
+	const struct gcov_info *const *info;
+	struct GcovDump d;
+	int n = 0;
+
+	printfmt(gcov_putch, NULL, "# BEGIN gcov\n");
+	for (info = __gcov_info_start; info < __gcov_info_end; info++) {
+		d.col = d.used = 0;
+		__gcov_info_to_gcda(*info, gcov_filename, gcov_data,
+				    gcov_allocate, &d);
+		if (d.col)
+			serial_putc('\n');
+		n++;
+	}
+	printfmt(gcov_putch, NULL, "# END gcov\n");
+	return n;
+}
+
+// Merging counters into existing .gcda files is the host's business;
+// the compiler still references the merge function from every
+// gcov_info, so define it here rather than pull in libgcov's, which
+// wants file I/O.
+void
+__gcov_merge_add(int64_t *counters, unsigned n)
+{
+}
+
+// __gcov_info_to_gcda() only reaches for these while dumping value
+// profiles, which PGO=gen doesn't collect.
+void
+abort(void)
+{
+	panic("gcov: abort");
+}
+
+void *
+mmap(void *addr, size_t len, int prot, int flags, int fd, uint32_t off)
+{
+	return (void *) -1;
+}
+
+#else
+
+int
+gcov_dump(void)
+{
+	return -1;
+}
+
+#endif	// CONFIG_PGO_GEN
@@ -0,0 +1,15 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_GCOV_H
+#define JOS_KERN_GCOV_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+#define GCOV_ARENA_SIZE		4096	// scratch memory for one object's dump
+
+int gcov_dump(void);
+
+#endif	// !JOS_KERN_GCOV_H
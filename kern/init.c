@@ -3,9 +3,15 @@
 #include <inc/stdio.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/x86.h>
+#include <inc/mmu.h>
 
 #include <kern/monitor.h>
 #include <kern/console.h>
+#include <kern/trap.h>
+#include <kern/picirq.h>
+#include <kern/tsc.h>
+#include <kern/cpu.h>
 
 #include <inc/uefi.h>
 #include <kern/uefi_f.h>
@@ -22,45 +28,91 @@ test_backtrace(int x)
 	cprintf("leaving test_backtrace %d\n", x);
 }
 
+static void boot_aps(void);
+
+// The page directory paging_init turned on, or NULL if paging is off.
+static pde_t *kern_pgdir;
+
+// Load 'pgdir' and turn paging on, on this CPU.  The loader marks
+// framebuffer pages with PAT entry 4, which we make write-combining
+// first; the PAT is per-CPU, so every AP does this too.
+static void
+paging_on(pde_t *pgdir)
+{
+	uint32_t edx;
+
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (edx & CPUID_PAT)
+		wrmsr(MSR_PAT, (rdmsr(MSR_PAT) & ~(0xffULL << 32)) |
+		      ((uint64_t) PAT_WC << 32));
+	lcr4(rcr4() | CR4_PSE);
+	lcr3((uint32_t) pgdir);
+	lcr0(rcr0() | CR0_PG | CR0_WP);
+}
+
+// Turn paging on with the loader's 4MB-page directory, if it built
+// one.  It maps everything we run from at its physical address, so
+// this is just a few register loads.
+static void
+paging_init(LOADER_PARAMS *lp)
+{
+	uint32_t edx;
+
+	if (!LOADER_PARAMS_HAS(lp, LOADER_PAGE_DIRECTORY) || !lp->Page_Directory)
+		return;
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (!(edx & CPUID_PSE))
+		return;
+
+	kern_pgdir = (pde_t *) (uint32_t) lp->Page_Directory;
+	paging_on(kern_pgdir);
+}
+
 void
-i386_init(void)
+i386_init(LOADER_PARAMS *lp)
 {
 	extern char edata[], end[];
+	uint64_t entry_tsc = read_tsc(), tsc;
 
 	// Before doing anything else, complete the ELF loading process.
 	// Clear the uninitialized global data (BSS) section of our program.
 	// This ensures that all static/global variables start out zero.
 
-  LOADER_PARAMS* uefi_params = UEFI_LP; //ugly way to save uefi params pointer
 	memset(edata, 0, end - edata);
-  UEFI_LP = uefi_params; //ugly way to save uefi params pointer
+
+	// The loader's parameter block lives outside BSS, in loader memory.
+	// It is NULL when the legacy boot loader started us.
+	UEFI_LP = lp;
+	paging_init(lp);
+	boot_stamp(BOOT_STAMP_KERNEL_ENTRY, entry_tsc);
 
 	// Initialize the console.
 	// Can't call cprintf until after we do this!
 	cons_init();
+	boot_stamp(BOOT_STAMP_CONSOLE, tsc = read_tsc());
+	boot_marker("entry", entry_tsc);
+	boot_marker("cons_init", tsc);
 	init_memory_map(); // initial new memory map
-			
-			//Test Allocate One
-			EFI_PHYSICAL_ADDRESS memetest ;
-			AllocatePages( AllocateAnyPages, EfiReservedMemoryType , 7, &memetest );
-			AllocatePages( AllocateAnyPages, EfiReservedMemoryType , 7, &memetest );
-			AllocatePages( AllocateAnyPages, EfiReservedMemoryType , 146, &memetest );
-			memetest=0x3000;
-			FreePages(  &memetest , 3 ); 
-			//Test Allocate One Done
-
-			//Test Allocate Two
-			// EFI_PHYSICAL_ADDRESS memetest = 0xA000;
-			// AllocatePages( AllocateMaxAddress, EfiReservedMemoryType , 19, &memetest );
-			// AllocatePages( AllocateMaxAddress, EfiReservedMemoryType , 2, &memetest );
-			//Test Allocate Two Done
-	
-			//Test Allocate Three 
-			// EFI_PHYSICAL_ADDRESS memetest = 0xA000;
-			// AllocatePages( AllocateAddress, EfiReservedMemoryType , 10 , &memetest );
-			//
-			//Test Allocate Three Done
+	boot_stamp(BOOT_STAMP_MEMORY_MAP, tsc = read_tsc());
+	boot_marker("init_memory_map", tsc);
+
+	// Calibrate the TSC, so everything after can report real time.
+	tsc_init();
+	boot_marker("tsc_init", read_tsc());
+
+	// Take exceptions and interrupts away from the firmware.
+	// All IRQs stay masked until something (e.g. the profiler) asks.
+	trap_init();
+	pic_init();
+	boot_stamp(BOOT_STAMP_TRAPS, tsc = read_tsc());
+	boot_marker("trap_init", tsc);
 
+	// Find the other CPUs and start them.  This wants a free page
+	// in low memory for their entry code, which stays allocated.
+	mp_init();
+	lapic_init();
+	boot_aps();
+	boot_marker("boot_aps", read_tsc());
 
 	cprintf("6828 decimal is %o octal!\n", 6828);
   	cprintf("alignof uint64_t is %d\n", __alignof(uint64_t));
@@ -68,11 +120,125 @@ i386_init(void)
 	test_backtrace(5);
 
 	// Drop into the kernel monitor.
+	boot_marker("monitor", read_tsc());
 	while (1)
 	monitor(NULL);
 }
 
 
+// While boot_aps is booting a given CPU, it communicates the per-core
+// stack pointer that should be loaded by mpentry.S to that CPU in
+// this variable.
+void *mpentry_kstack;
+
+// Start the non-boot (AP) processors.
+static void
+boot_aps(void)
+{
+	extern unsigned char mpentry_start[], mpentry_start32[], mpentry_end[],
+		mpentry_gdtdesc[], mpentry_farjmp[], mpentry_dsel[];
+	EFI_PHYSICAL_ADDRESS pa;
+	struct CpuInfo *c;
+	unsigned char *code;
+	uint64_t start, deadline;
+	uint16_t cs, ds;
+
+	if (ncpu < 2 || !lapicaddr)
+		return;
+
+	// Find a page below MPENTRY_MAX for the entry code.  It stays
+	// allocated, in case an AP we gave up on starts after all.
+	for (pa = PGSIZE; pa < MPENTRY_MAX; pa += PGSIZE)
+		if (AllocatePages(AllocateAddress, EfiLoaderCode, 1, &pa) == EFI_SUCCESS)
+			break;
+	if (pa >= MPENTRY_MAX) {
+		cprintf("SMP: no free page below 0x%x for AP entry code\n",
+			MPENTRY_MAX);
+		return;
+	}
+
+	// Write entry code to unused memory, and patch in our GDT and
+	// segments, and where the 32-bit half ended up.
+	code = (unsigned char *) (uint32_t) pa;
+	memmove(code, mpentry_start, mpentry_end - mpentry_start);
+	asm volatile("sgdt %0" : "=m" (*(struct Pseudodesc *)
+		     (code + (mpentry_gdtdesc - mpentry_start))));
+	asm volatile("movw %%cs,%0" : "=r" (cs));
+	asm volatile("movw %%ds,%0" : "=r" (ds));
+	*(uint32_t *) (code + (mpentry_farjmp - mpentry_start)) =
+		(uint32_t) pa + (mpentry_start32 - mpentry_start);
+	*(uint16_t *) (code + (mpentry_farjmp - mpentry_start) + 4) = cs;
+	*(uint16_t *) (code + (mpentry_dsel - mpentry_start)) = ds;
+
+	// Boot each AP one at a time
+	for (c = cpus; c < cpus + ncpu; c++) {
+		if (c == bootcpu)  // We've started already.
+			continue;
+
+		// Tell mpentry.S what stack to use
+		mpentry_kstack = percpu_kstacks[c - cpus] + KSTKSIZE;
+		// Start the CPU at mpentry_start
+		start = ktime_ns();
+		lapic_startap(c->cpu_apicid, (uint32_t) pa);
+		// Wait for the CPU to finish some basic setup in mp_main()
+		deadline = start + AP_START_TIMEOUT_MS * 1000000ULL;
+		while (c->cpu_status != CPU_STARTED && ktime_ns() < deadline)
+			asm volatile("pause");
+		if (c->cpu_status == CPU_STARTED)
+			c->cpu_boot_ns = ktime_ns() - start;
+		else {
+			c->cpu_status = CPU_FAILED;
+			cprintf("SMP: CPU %d (APIC %d) did not start\n",
+				c->cpu_id, c->cpu_apicid);
+		}
+	}
+}
+
+// Setup code for APs
+void
+mp_main(void)
+{
+	if (kern_pgdir)
+		paging_on(kern_pgdir);
+
+	lapic_init();
+	trap_init_percpu();
+	xchg(&thiscpu->cpu_status, CPU_STARTED); // tell boot_aps() we're up
+
+	// Nothing to schedule yet: sleep until another CPU gives us a
+	// call to run.  sti takes effect only after the hlt, so an IPI
+	// sent after the check still wakes us.
+	for (;;) {
+		asm volatile("cli");
+		while (!thiscpu->cpu_call)
+			asm volatile("sti; hlt; cli");
+		thiscpu->cpu_call(thiscpu->cpu_call_arg);
+		thiscpu->cpu_call = NULL;
+	}
+}
+
+// Have CPU c run fn(arg) from its idle loop, and return without
+// waiting for it; cpu_call_wait() does that.  Returns -1 if c is not
+// running, is this CPU, or hasn't finished its last call yet.
+int
+cpu_call(struct CpuInfo *c, void (*fn)(void *), void *arg)
+{
+	if (c->cpu_status != CPU_STARTED || c == thiscpu || c->cpu_call)
+		return -1;
+	c->cpu_call_arg = arg;
+	c->cpu_call = fn;
+	lapic_ipi(c->cpu_apicid, IRQ_OFFSET + IRQ_IPI);
+	return 0;
+}
+
+// Wait for CPU c to return from the function cpu_call() gave it.
+void
+cpu_call_wait(struct CpuInfo *c)
+{
+	while (c->cpu_call)
+		asm volatile("pause");
+}
+
 /*
  * Variable panicstr contains argument to first call to panic; used as flag
  * to indicate that the kernel has already called panic.
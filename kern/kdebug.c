@@ -2,6 +2,7 @@
 #include <inc/string.h>
 #include <inc/memlayout.h>
 #include <inc/assert.h>
+#include <inc/probe.h>
 
 #include <kern/kdebug.h>
 
@@ -10,6 +11,32 @@ extern const struct Stab __STAB_END__[];	// End of stabs table
 extern const char __STABSTR_BEGIN__[];		// Beginning of string table
 extern const char __STABSTR_END__[];		// End of string table
 
+// Address-sorted symbol/line index generated after the first link by
+// kern/mksymidx.pl.  Each row covers [si_addr, next row's si_addr).
+struct Symidx {
+	uintptr_t si_addr;	// First address covered by this row
+	uintptr_t si_fn_addr;	// Start of the enclosing function
+	uint32_t si_fn;		// Function name (.symidxstr offset, 0 = none)
+	uint32_t si_file;	// Source file name (.symidxstr offset)
+	uint16_t si_line;	// Source line number
+	uint16_t si_narg;	// Number of function arguments
+};
+
+extern const struct Symidx __SYMIDX_BEGIN__[];	// Beginning of index
+extern const struct Symidx __SYMIDX_END__[];	// End of index
+extern const char __SYMIDXSTR_BEGIN__[];	// Beginning of its strings
+extern const char __SYMIDXSTR_END__[];		// End of its strings
+
+// Recently resolved addresses, direct-mapped by address.
+// Backtraces and profiles ask about the same few EIPs over and over.
+#define DEBUGINFO_CACHE_SIZE	64
+
+static struct {
+	uintptr_t addr;
+	int result;
+	struct Eipdebuginfo info;
+} debuginfo_cache[DEBUGINFO_CACHE_SIZE];
+
 
 // stab_binsearch(stabs, region_left, region_right, type, addr)
 //
@@ -94,6 +121,59 @@ stab_binsearch(const struct Stab *stabs, int *region_left, int *region_right,
 }
 
 
+// symidx_lookup(addr, info)
+//
+//	Fill in '*info' from the prebuilt symbol index with one binary search
+//	for the last row starting at or below 'addr'.  Returns 0 on success,
+//	negative if the index has no function for 'addr'.
+//
+static int
+symidx_lookup(uintptr_t addr, struct Eipdebuginfo *info)
+{
+	const struct Symidx *idx = __SYMIDX_BEGIN__;
+	const char *str = __SYMIDXSTR_BEGIN__;
+	int l = 0, r = (__SYMIDX_END__ - __SYMIDX_BEGIN__) - 1, m;
+
+	if (r < 0 || addr < idx[0].si_addr)
+		return -1;
+	while (l < r) {
+		m = (l + r + 1) / 2;
+		if (idx[m].si_addr <= addr)
+			l = m;
+		else
+			r = m - 1;
+	}
+
+	if (idx[l].si_file)
+		info->eip_file = str + idx[l].si_file;
+	info->eip_line = idx[l].si_line;
+	if (idx[l].si_fn == 0)
+		return idx[l].si_line ? 0 : -1;
+	info->eip_fn_name = str + idx[l].si_fn;
+	info->eip_fn_namelen = strlen(info->eip_fn_name);
+	info->eip_fn_addr = idx[l].si_fn_addr;
+	info->eip_fn_narg = idx[l].si_narg;
+	return 0;
+}
+
+// debuginfo_sample_eip(k, n)
+//
+//	The k'th of n addresses spread evenly over the symbol index, for
+//	timing lookups across the whole kernel.  Returns 0 if the index is
+//	empty.
+//
+uintptr_t
+debuginfo_sample_eip(uint32_t k, uint32_t n)
+{
+	uint32_t rows = __SYMIDX_END__ - __SYMIDX_BEGIN__;
+
+	if (rows == 0 || n == 0)
+		return 0;
+	return __SYMIDX_BEGIN__[k % n * rows / n].si_addr;
+}
+
+static int debuginfo_stabs(uintptr_t addr, struct Eipdebuginfo *info);
+
 // debuginfo_eip(addr, info)
 //
 //	Fill in the 'info' structure with information about the specified
@@ -104,9 +184,15 @@ stab_binsearch(const struct Stab *stabs, int *region_left, int *region_right,
 int
 debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 {
-	const struct Stab *stabs, *stab_end;
-	const char *stabstr, *stabstr_end;
-	int lfile, rfile, lfun, rfun, lline, rline;
+	PROBE();
+	const struct Symidx *idx_end = __SYMIDX_END__;
+	int slot = (addr ^ (addr >> 6)) % DEBUGINFO_CACHE_SIZE;
+	int r;
+
+	if (debuginfo_cache[slot].addr == addr && addr != 0) {
+		*info = debuginfo_cache[slot].info;
+		return debuginfo_cache[slot].result;
+	}
 
 	// Initialize *info
 	info->eip_file = "<unknown>";
@@ -116,6 +202,35 @@ debuginfo_eip(uintptr_t addr, struct Eipdebuginfo *info)
 	info->eip_fn_addr = addr;
 	info->eip_fn_narg = 0;
 
+	if (addr > ULIM)
+		// Can't search for user-level addresses yet!
+		panic("User address");
+
+	// The index is empty only in the first-pass link that feeds
+	// mksymidx.pl; fall back to walking the stabs there.
+	if (idx_end > __SYMIDX_BEGIN__)
+		r = symidx_lookup(addr, info);
+	else
+		r = debuginfo_stabs(addr, info);
+
+	debuginfo_cache[slot].addr = addr;
+	debuginfo_cache[slot].result = r;
+	debuginfo_cache[slot].info = *info;
+	return r;
+}
+
+// debuginfo_stabs(addr, info)
+//
+//	The original debuginfo_eip(): look 'addr' up in the raw stabs.
+//	'*info' must already hold the "<unknown>" defaults.
+//
+static int
+debuginfo_stabs(uintptr_t addr, struct Eipdebuginfo *info)
+{
+	const struct Stab *stabs, *stab_end;
+	const char *stabstr, *stabstr_end;
+	int lfile, rfile, lfun, rfun, lline, rline;
+
 	// Find the relevant set of stabs
 	if (addr <= ULIM) {
 		stabs = __STAB_BEGIN__;
@@ -16,5 +16,6 @@ struct Eipdebuginfo {
 };
 
 int debuginfo_eip(uintptr_t eip, struct Eipdebuginfo *info);
+uintptr_t debuginfo_sample_eip(uint32_t k, uint32_t n);
 
 #endif
@@ -0,0 +1,102 @@
+#!/usr/bin/perl
+#
+# Usage: mklz4.pl <kernel-elf> > kernel.lz4
+#
+# Pack a linked kernel into the compressed container the UEFI loader looks
+# for next to the kernel (see JosPkg/Application/Loader/Lz4.c):
+#
+#	header		magic "JLZ4", version, ELF file size, prefix size,
+#			block count (all 32-bit little endian)
+#	prefix		the ELF file up to the end of its program headers,
+#			verbatim, so the loader can parse it as usual
+#	blocks		one (p_pa, p_filesz, packed size) triple per PT_LOAD
+#			segment with file contents
+#	data		each segment's file contents as a raw LZ4 block
+#
+# Section headers, symbols and DWARF are not loaded, so they are left out.
+
+use strict;
+
+use constant {
+	PT_LOAD		=> 1,
+	MINMATCH	=> 4,
+	MFLIMIT		=> 12,		# no match may start in the last 12 bytes
+	LASTLITERALS	=> 5,		# ... or cover any of the last 5
+	MAXOFFSET	=> 65535,
+};
+
+my $file = shift @ARGV or die "usage: mklz4.pl <kernel-elf>\n";
+open(my $fh, '<', $file) || die "open $file: $!";
+binmode $fh;
+my $elf = do { local $/; <$fh> };
+close $fh;
+
+substr($elf, 0, 4) eq "\x7fELF" || die "$file: not an ELF file\n";
+ord(substr($elf, 4, 1)) == 1 || die "$file: not a 32-bit ELF file\n";
+
+my ($phoff) = unpack('V', substr($elf, 28, 4));
+my ($phentsize, $phnum) = unpack('v2', substr($elf, 42, 4));
+my $prefix = $phoff + $phentsize * $phnum;
+
+my ($blocks, $data) = ('', '');
+for my $i (0 .. $phnum - 1) {
+	my ($type, $offset, $va, $pa, $filesz) =
+		unpack('V5', substr($elf, $phoff + $i * $phentsize, 20));
+	next if $type != PT_LOAD || $filesz == 0;
+	my $packed = lz4_block(substr($elf, $offset, $filesz));
+	$blocks .= pack('V3', $pa, $filesz, length($packed));
+	$data .= $packed;
+}
+
+binmode STDOUT;
+print pack('a4V4', 'JLZ4', 1, length($elf), $prefix, length($blocks) / 12);
+print substr($elf, 0, $prefix), $blocks, $data;
+
+# Length continuation bytes for a token nibble that saturated at 15.
+sub extlen {
+	my ($n) = @_;
+	return '' if $n < 15;
+	$n -= 15;
+	return ("\xff" x int($n / 255)) . chr($n % 255);
+}
+
+sub sequence {
+	my ($lit, $offset, $mlen) = @_;
+	my $ll = length($lit);
+	my $ml = defined($offset) ? $mlen - MINMATCH : 0;
+	my $s = chr((($ll < 15 ? $ll : 15) << 4) | ($ml < 15 ? $ml : 15))
+		. extlen($ll) . $lit;
+	return $s unless defined $offset;
+	return $s . pack('v', $offset) . extlen($ml);
+}
+
+# Greedy LZ4 block compression with a single-entry hash of the last
+# position each 4-byte string was seen at.  Kernel segments are small
+# and mostly zeros and strings, so this does nearly as well as lz4 -9.
+sub lz4_block {
+	my ($src) = @_;
+	my $n = length($src);
+	my ($out, $anchor, $i, %last) = ('', 0, 0);
+
+	while ($i < $n - MFLIMIT) {
+		my $key = substr($src, $i, MINMATCH);
+		my $ref = $last{$key};
+		$last{$key} = $i;
+		if (!defined($ref) || $i - $ref > MAXOFFSET) {
+			$i++;
+			next;
+		}
+
+		my $len = MINMATCH;
+		my $max = $n - LASTLITERALS - $i;
+		$len += 64 while $len + 64 <= $max &&
+			substr($src, $ref + $len, 64) eq substr($src, $i + $len, 64);
+		$len++ while $len < $max &&
+			substr($src, $ref + $len, 1) eq substr($src, $i + $len, 1);
+
+		$out .= sequence(substr($src, $anchor, $i - $anchor), $i - $ref, $len);
+		$i += $len;
+		$anchor = $i;
+	}
+	return $out . sequence(substr($src, $anchor));
+}
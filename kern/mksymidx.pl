@@ -0,0 +1,519 @@
+#!/usr/bin/perl
+#
+# Usage: mksymidx.pl <kernel-elf> > symidx.S
+#
+# Build the kernel's symbol/line index from the debugging information in
+# a linked kernel: DWARF (.debug_line for lines, DW_TAG_subprogram DIEs in
+# .debug_info for functions) if present, otherwise STABS.  The output is
+# assembler source for two sections that kern/kernel.ld places after
+# .stabstr:
+#
+#	.symidx		struct Symidx rows (see kern/kdebug.c), sorted by
+#			address; each row covers [si_addr, next row's si_addr)
+#	.symidxstr	NUL-terminated function and file names
+#
+# debuginfo_eip() then needs a single binary search per lookup instead of
+# walking the stabs.  Rows with si_fn == 0 cover addresses with no
+# enclosing function (assembly files, gaps after a function's end).
+
+use strict;
+
+use constant {
+	N_FUN	=> 0x24,
+	N_SLINE	=> 0x44,
+	N_SO	=> 0x64,
+	N_SOL	=> 0x84,
+	N_PSYM	=> 0xa0,
+};
+
+my $file = shift @ARGV or die "usage: mksymidx.pl <kernel-elf>\n";
+open(my $fh, '<', $file) || die "open $file: $!";
+binmode $fh;
+my $elf = do { local $/; <$fh> };
+close $fh;
+
+substr($elf, 0, 4) eq "\x7fELF" || die "$file: not an ELF file\n";
+ord(substr($elf, 4, 1)) == 1 || die "$file: not a 32-bit ELF file\n";
+
+# Find the sections by name.
+my ($shoff) = unpack('V', substr($elf, 32, 4));
+my ($shentsize, $shnum, $shstrndx) = unpack('v3', substr($elf, 46, 6));
+my @sh;
+for my $i (0 .. $shnum - 1) {
+	my ($name, $type, $flags, $addr, $off, $size) =
+		unpack('V6', substr($elf, $shoff + $i * $shentsize, 24));
+	push @sh, { name => $name, off => $off, size => $size };
+}
+my %sect;
+for my $s (@sh) {
+	my $name = unpack('Z*', substr($elf, $sh[$shstrndx]{off} + $s->{name}));
+	$sect{$name} = $s;
+}
+
+sub section {
+	my ($name) = @_;
+	return '' if !$sect{$name};
+	return substr($elf, $sect{$name}{off}, $sect{$name}{size});
+}
+
+my (@rows, %stroff);
+my $strtab = "\0";
+
+sub str {
+	my ($s) = @_;
+	return 0 if !defined($s) || $s eq '';
+	if (!exists $stroff{$s}) {
+		$stroff{$s} = length($strtab);
+		$strtab .= "$s\0";
+	}
+	return $stroff{$s};
+}
+
+sub row {
+	my ($addr, $fn, $fn_addr, $file, $line, $narg) = @_;
+	push @rows, [ $addr, $fn_addr, str($fn), str($file), $line, $narg ];
+}
+
+if ($sect{'.debug_line'}) {
+	dwarf_rows();
+} elsif ($sect{'.stab'} && $sect{'.stabstr'}) {
+	stabs_rows();
+}
+
+# Sort by address.  The sort is stable, so of several rows for the same
+# address the last one emitted wins, as in stab_binsearch.
+@rows = sort { $a->[0] <=> $b->[0] } @rows;
+my @out;
+for my $r (@rows) {
+	pop @out if @out && $out[-1][0] == $r->[0];
+	push @out, $r;
+}
+
+print "# Generated by kern/mksymidx.pl from $file.  Do not edit.\n\n";
+print "\t.section .symidx, \"a\"\n";
+print "\t.p2align 2\n";
+for my $r (@out) {
+	printf "\t.long\t0x%08x, 0x%08x, %u, %u\n", @$r[0 .. 3];
+	printf "\t.short\t%u, %u\n", $r->[4] & 0xffff, $r->[5];
+}
+print "\n\t.section .symidxstr, \"a\"\n";
+print "\t.byte\t0\n";
+for my $s (split(/\0/, substr($strtab, 1))) {
+	$s =~ s/(["\\])/\\$1/g;
+	print "\t.asciz\t\"$s\"\n";
+}
+exit 0;
+
+
+###################################################################
+# STABS
+###################################################################
+
+sub stabs_rows {
+	my $stab = section('.stab');
+	my $sstr = section('.stabstr');
+	my $n = int(length($stab) / 12);
+	my ($file, $fn, $fn_addr, $narg, $in_fn) = (undef, undef, 0, 0, 0);
+
+	for (my $i = 0; $i < $n; $i++) {
+		my ($strx, $type, $other, $desc, $value) =
+			unpack('VCCvV', substr($stab, $i * 12, 12));
+		my $name = $strx < length($sstr) ? unpack('Z*', substr($sstr, $strx)) : '';
+
+		if ($type == N_SO) {
+			if ($name eq '') {
+				# End of a compilation unit.
+				row($value, undef, $value, undef, 0, 0) if $value;
+				($file, $in_fn) = (undef, 0);
+			} elsif ($name !~ m{/$}) {
+				# A leading N_SO naming the directory ends in '/'.
+				$file = $name;
+				$in_fn = 0;
+			}
+		} elsif ($type == N_SOL) {
+			$file = $name;
+		} elsif ($type == N_FUN) {
+			if ($name eq '') {
+				# End of function; the value is its size.
+				row($fn_addr + $value, undef, $fn_addr + $value, $file, 0, 0);
+				$in_fn = 0;
+			} else {
+				($fn = $name) =~ s/:.*//;
+				($fn_addr, $narg, $in_fn) = ($value, 0, 1);
+				for (my $j = $i + 1; $j < $n; $j++) {
+					last if unpack('C', substr($stab, $j * 12 + 4, 1)) != N_PSYM;
+					$narg++;
+				}
+				row($fn_addr, $fn, $fn_addr, $file, $desc, $narg);
+			}
+		} elsif ($type == N_SLINE) {
+			# Line numbers inside a function are relative to its start.
+			if ($in_fn) {
+				row($fn_addr + $value, $fn, $fn_addr, $file, $desc, $narg);
+			} else {
+				row($value, undef, $value, $file, $desc, 0);
+			}
+		}
+	}
+}
+
+
+###################################################################
+# DWARF (versions 2 to 5, 32-bit format)
+###################################################################
+
+my ($debug_str, $debug_line_str, $debug_str_offsets, $debug_addr);
+
+sub uleb {
+	my ($buf, $pos) = @_;
+	my ($v, $shift, $b) = (0, 0);
+	do {
+		$b = ord(substr($$buf, $$pos++, 1));
+		$v += ($b & 0x7f) * (2 ** $shift);
+		$shift += 7;
+	} while ($b & 0x80);
+	return $v;
+}
+
+sub sleb {
+	my ($buf, $pos) = @_;
+	my ($v, $shift, $b) = (0, 0);
+	do {
+		$b = ord(substr($$buf, $$pos++, 1));
+		$v += ($b & 0x7f) * (2 ** $shift);
+		$shift += 7;
+	} while ($b & 0x80);
+	$v -= 2 ** $shift if $b & 0x40;
+	return $v;
+}
+
+sub u8	{ my ($b, $p) = @_; $$p += 1; return unpack('C', substr($$b, $$p - 1, 1)); }
+sub u16	{ my ($b, $p) = @_; $$p += 2; return unpack('v', substr($$b, $$p - 2, 2)); }
+sub u32	{ my ($b, $p) = @_; $$p += 4; return unpack('V', substr($$b, $$p - 4, 4)); }
+sub cstr { my ($b, $p) = @_; my $s = unpack('Z*', substr($$b, $$p)); $$p += length($s) + 1; return $s; }
+
+# Read one attribute value of form $form at $$pos.  Numbers come back as
+# numbers, strings as strings; block-like forms are skipped (undef).
+# $cu supplies the address size, DWARF version and the str/addr bases.
+sub form_value {
+	my ($buf, $pos, $form, $cu) = @_;
+	my $asz = $cu->{addr_size};
+
+	if ($form == 0x01) {			# addr
+		$$pos += $asz;
+		return unpack('V', substr($$buf, $$pos - $asz, 4));
+	}
+	return u16($buf, $pos) if $form == 0x05 || $form == 0x12;	# data2, ref2
+	return u32($buf, $pos) if $form == 0x06 || $form == 0x13 ||	# data4, ref4
+		$form == 0x17 || $form == 0x1c;				# sec_offset, ref_sup4
+	return u8($buf, $pos) if $form == 0x0b || $form == 0x0c ||	# data1, flag
+		$form == 0x11;						# ref1
+	if ($form == 0x07 || $form == 0x14 || $form == 0x20 || $form == 0x24) {
+		$$pos += 8;			# data8, ref8, ref_sig8, ref_sup8
+		return unpack('V', substr($$buf, $$pos - 8, 4));
+	}
+	return cstr($buf, $pos) if $form == 0x08;			# string
+	return sleb($buf, $pos) if $form == 0x0d;			# sdata
+	return uleb($buf, $pos) if $form == 0x0f || $form == 0x15 ||	# udata, ref_udata
+		$form == 0x22 || $form == 0x23;				# loclistx, rnglistx
+	if ($form == 0x0e || $form == 0x1f) {				# strp, line_strp
+		my $off = u32($buf, $pos);
+		return unpack('Z*', substr($form == 0x0e ? $debug_str : $debug_line_str, $off));
+	}
+	if ($form == 0x10) {						# ref_addr
+		$$pos += $cu->{version} == 2 ? $asz : 4;
+		return undef;
+	}
+	if ($form == 0x1a || ($form >= 0x25 && $form <= 0x28)) {	# strx*
+		my $idx = $form == 0x1a ? uleb($buf, $pos) :
+			  $form == 0x25 ? u8($buf, $pos) :
+			  $form == 0x26 ? u16($buf, $pos) :
+			  $form == 0x27 ? u16($buf, $pos) + 65536 * u8($buf, $pos) :
+			  u32($buf, $pos);
+		return [ 'strx', $idx ];
+	}
+	if ($form == 0x1b || ($form >= 0x29 && $form <= 0x2c)) {	# addrx*
+		my $idx = $form == 0x1b ? uleb($buf, $pos) :
+			  $form == 0x29 ? u8($buf, $pos) :
+			  $form == 0x2a ? u16($buf, $pos) :
+			  $form == 0x2b ? u16($buf, $pos) + 65536 * u8($buf, $pos) :
+			  u32($buf, $pos);
+		return [ 'addrx', $idx ];
+	}
+	if ($form == 0x1d) { $$pos += 4; return undef; }		# strp_sup
+	if ($form == 0x1e) { $$pos += 16; return undef; }		# data16
+	if ($form == 0x19 || $form == 0x21) { return 1; }		# flag_present, implicit_const
+	if ($form == 0x0a) { $$pos += u8($buf, $pos); return undef; }	# block1
+	if ($form == 0x03) { $$pos += u16($buf, $pos); return undef; }	# block2
+	if ($form == 0x04) { $$pos += u32($buf, $pos); return undef; }	# block4
+	if ($form == 0x09 || $form == 0x18) {				# block, exprloc
+		$$pos += uleb($buf, $pos);
+		return undef;
+	}
+	if ($form == 0x16) {						# indirect
+		return form_value($buf, $pos, uleb($buf, $pos), $cu);
+	}
+	die sprintf("mksymidx.pl: unknown DWARF form 0x%x\n", $form);
+}
+
+# Resolve DWARF 5 strx/addrx indices once the CU's bases are known.
+sub resolve {
+	my ($v, $cu) = @_;
+	return $v if ref($v) ne 'ARRAY';
+	my ($kind, $idx) = @$v;
+	if ($kind eq 'strx') {
+		my $off = unpack('V', substr($debug_str_offsets,
+			$cu->{str_offsets_base} + 4 * $idx, 4));
+		return unpack('Z*', substr($debug_str, $off));
+	}
+	return unpack('V', substr($debug_addr,
+		$cu->{addr_base} + $cu->{addr_size} * $idx, 4));
+}
+
+# Function DIEs: list of [low_pc, high_pc, name, narg].
+sub dwarf_functions {
+	my $info = section('.debug_info');
+	my $abbrev = section('.debug_abbrev');
+	my @fns;
+	my $pos = 0;
+
+	while ($pos < length($info)) {
+		my $cu_start = $pos;
+		my $len = u32(\$info, \$pos);
+		die "mksymidx.pl: 64-bit DWARF not supported\n" if $len == 0xffffffff;
+		my $cu_end = $pos + $len;
+		my %cu = (version => u16(\$info, \$pos));
+		my $abbrev_off;
+		if ($cu{version} >= 5) {
+			my $unit_type = u8(\$info, \$pos);
+			$cu{addr_size} = u8(\$info, \$pos);
+			$abbrev_off = u32(\$info, \$pos);
+			# Skeleton/split/type units carry an id or signature.
+			$pos += 8 if $unit_type == 2 || $unit_type == 4 || $unit_type == 5;
+			$pos += 4 if $unit_type == 2 || $unit_type == 6;
+		} else {
+			$abbrev_off = u32(\$info, \$pos);
+			$cu{addr_size} = u8(\$info, \$pos);
+		}
+
+		# Parse this unit's abbreviation table.
+		my (%abbr, $apos);
+		$apos = $abbrev_off;
+		while (1) {
+			my $code = uleb(\$abbrev, \$apos);
+			last if $code == 0;
+			my $tag = uleb(\$abbrev, \$apos);
+			my $children = u8(\$abbrev, \$apos);
+			my @attrs;
+			while (1) {
+				my $at = uleb(\$abbrev, \$apos);
+				my $form = uleb(\$abbrev, \$apos);
+				last if $at == 0 && $form == 0;
+				my $const = $form == 0x21 ? sleb(\$abbrev, \$apos) : undef;
+				push @attrs, [ $at, $form, $const ];
+			}
+			$abbr{$code} = [ $tag, $children, \@attrs ];
+		}
+
+		# Walk the DIE tree.
+		my (%names, @cu_fns, @stack);
+		my $depth = 0;
+		while ($pos < $cu_end) {
+			my $die_off = $pos - $cu_start;
+			my $code = uleb(\$info, \$pos);
+			if ($code == 0) {
+				$depth--;
+				pop @stack;
+				next;
+			}
+			my ($tag, $children, $attrs) = @{$abbr{$code}};
+			my %a;
+			for my $at (@$attrs) {
+				my ($name, $form, $const) = @$at;
+				my $v = form_value(\$info, \$pos, $form, \%cu);
+				$v = $const if $form == 0x21;
+				$a{$name} = [ $v, $form ];
+			}
+
+			if ($tag == 0x11) {		# DW_TAG_compile_unit
+				$cu{str_offsets_base} = $a{0x72}[0] if $a{0x72};
+				$cu{addr_base} = $a{0x73}[0] if $a{0x73};
+			}
+			$names{$die_off} = $a{0x03}[0] if $a{0x03};
+			if ($tag == 0x2e && $a{0x11} && $a{0x12}) {
+				# DW_TAG_subprogram with DW_AT_low_pc/high_pc.
+				# Out-of-line copies of inlined functions name
+				# their DW_AT_abstract_origin instead.
+				my $f = { low => $a{0x11}[0], high => $a{0x12},
+					  name => $a{0x03} ? $a{0x03}[0] : undef,
+					  origin => $a{0x31} ? $a{0x31}[0] : undef,
+					  narg => 0 };
+				push @cu_fns, $f;
+				$stack[$depth] = $f;
+			} else {
+				$stack[$depth] = undef;
+			}
+			if ($tag == 0x05 && $depth > 0 && $stack[$depth - 1]) {
+				$stack[$depth - 1]{narg}++;	# DW_TAG_formal_parameter
+			}
+			$depth++ if $children;
+		}
+
+		for my $f (@cu_fns) {
+			my $low = resolve($f->{low}, \%cu);
+			my ($hv, $hform) = @{$f->{high}};
+			my $high = resolve($hv, \%cu);
+			# A constant-class high_pc is an offset from low_pc.
+			$high += $low if $hform != 0x01 && ref($hv) ne 'ARRAY';
+			my $name = resolve($f->{name}, \%cu);
+			$name = resolve($names{$f->{origin}}, \%cu)
+				if !defined($name) && defined($f->{origin});
+			# Functions the linker discarded are left at address 0.
+			push @fns, [ $low, $high, $name, $f->{narg} ]
+				if $low != 0 && $high > $low;
+		}
+		$pos = $cu_end;
+	}
+	return sort { $a->[0] <=> $b->[0] } @fns;
+}
+
+# Line table rows: list of [addr, file, line]; end of sequence has no file.
+sub dwarf_lines {
+	my $line = section('.debug_line');
+	my @lines;
+	my $pos = 0;
+
+	while ($pos < length($line)) {
+		my $len = u32(\$line, \$pos);
+		die "mksymidx.pl: 64-bit DWARF not supported\n" if $len == 0xffffffff;
+		my $end = $pos + $len;
+		my %cu = (version => u16(\$line, \$pos), addr_size => 4);
+		if ($cu{version} >= 5) {
+			$cu{addr_size} = u8(\$line, \$pos);
+			u8(\$line, \$pos);		# segment_selector_size
+		}
+		my $hdr_len = u32(\$line, \$pos);
+		my $prog = $pos + $hdr_len;
+		my $min_inst = u8(\$line, \$pos);
+		u8(\$line, \$pos) if $cu{version} >= 4;	# maximum_operations_per_instruction
+		my $default_stmt = u8(\$line, \$pos);
+		my $line_base = unpack('c', substr($line, $pos++, 1));
+		my $line_range = u8(\$line, \$pos);
+		my $opcode_base = u8(\$line, \$pos);
+		my @oplen = (0, map { u8(\$line, \$pos) } 1 .. $opcode_base - 1);
+
+		my (@dirs, @files);
+		if ($cu{version} >= 5) {
+			for my $list (\@dirs, \@files) {
+				my $nfmt = u8(\$line, \$pos);
+				my @fmt = map { [ uleb(\$line, \$pos), uleb(\$line, \$pos) ] } 1 .. $nfmt;
+				my $count = uleb(\$line, \$pos);
+				for (1 .. $count) {
+					my %e;
+					for my $f (@fmt) {
+						$e{$f->[0]} = form_value(\$line, \$pos, $f->[1], \%cu);
+					}
+					push @$list, [ $e{1}, $e{2} || 0 ];	# DW_LNCT_path, directory_index
+				}
+			}
+		} else {
+			# Index 0 is the compilation directory; files start at 1.
+			push @dirs, [ '' ];
+			while ((my $d = cstr(\$line, \$pos)) ne '') {
+				push @dirs, [ $d ];
+			}
+			push @files, undef;
+			while ((my $f = cstr(\$line, \$pos)) ne '') {
+				my $dir = uleb(\$line, \$pos);
+				uleb(\$line, \$pos);	# mtime
+				uleb(\$line, \$pos);	# length
+				push @files, [ $f, $dir ];
+			}
+		}
+		# Name files relative to the compilation directory, as the
+		# compiler saw them on its command line.
+		my @names = map {
+			!defined($_) ? undef :
+			$_->[0] =~ m{^/} || $_->[1] == 0 ? $_->[0] :
+			"$dirs[$_->[1]][0]/$_->[0]"
+		} @files;
+
+		$pos = $prog;
+		my ($addr, $fileno, $lineno) = (0, 1, 1);
+		while ($pos < $end) {
+			my $op = u8(\$line, \$pos);
+			if ($op >= $opcode_base) {
+				my $adj = $op - $opcode_base;
+				$addr += int($adj / $line_range) * $min_inst;
+				$lineno += $line_base + $adj % $line_range;
+				push @lines, [ $addr, $names[$fileno], $lineno ];
+			} elsif ($op == 0) {
+				my $elen = uleb(\$line, \$pos);
+				my $epos = $pos;
+				my $eop = u8(\$line, \$pos);
+				if ($eop == 1) {		# end_sequence
+					push @lines, [ $addr, undef, 0 ];
+					($addr, $fileno, $lineno) = (0, 1, 1);
+				} elsif ($eop == 2) {		# set_address
+					$addr = unpack('V', substr($line, $pos, 4));
+				}
+				$pos = $epos + $elen;
+			} elsif ($op == 1) {			# copy
+				push @lines, [ $addr, $names[$fileno], $lineno ];
+			} elsif ($op == 2) {			# advance_pc
+				$addr += uleb(\$line, \$pos) * $min_inst;
+			} elsif ($op == 3) {			# advance_line
+				$lineno += sleb(\$line, \$pos);
+			} elsif ($op == 4) {			# set_file
+				$fileno = uleb(\$line, \$pos);
+			} elsif ($op == 8) {			# const_add_pc
+				$addr += int((255 - $opcode_base) / $line_range) * $min_inst;
+			} elsif ($op == 9) {			# fixed_advance_pc
+				$addr += u16(\$line, \$pos);
+			} else {
+				# Other standard opcodes only take ULEB operands.
+				uleb(\$line, \$pos) for 1 .. $oplen[$op];
+			}
+		}
+		$pos = $end;
+	}
+	return @lines;
+}
+
+sub dwarf_rows {
+	$debug_str = section('.debug_str');
+	$debug_line_str = section('.debug_line_str');
+	$debug_str_offsets = section('.debug_str_offsets');
+	$debug_addr = section('.debug_addr');
+
+	my @fns = dwarf_functions();
+	my @lines = dwarf_lines();
+
+	# Merge the two lists.  A new row starts at every line-table row and
+	# at every function start and end.  Where several coincide, ends are
+	# applied before starts, so the last row for an address (the one
+	# that is kept) sees the new function and line.
+	my %prio = (endfn => 0, endseq => 1, line => 2, fn => 3);
+	my @events;
+	push @events, map { [ $_->[0], defined($_->[1]) ? 'line' : 'endseq', $_ ] } @lines;
+	push @events, map { ([ $_->[0], 'fn', $_ ], [ $_->[1], 'endfn', $_ ]) } @fns;
+	@events = sort { $a->[0] <=> $b->[0] ||
+			 $prio{$a->[1]} <=> $prio{$b->[1]} } @events;
+
+	my ($fn, $file, $lineno) = (undef, undef, 0);
+	for my $e (@events) {
+		my ($addr, $kind, $x) = @$e;
+		if ($kind eq 'line' || $kind eq 'endseq') {
+			($file, $lineno) = ($x->[1], $x->[2]);
+		} elsif ($kind eq 'fn') {
+			$fn = $x;
+		} elsif ($fn && $fn == $x) {
+			$fn = undef;
+		}
+		if ($fn) {
+			row($addr, $fn->[2], $fn->[0], $file, $lineno, $fn->[3]);
+		} else {
+			row($addr, undef, $addr, $file, $lineno, 0);
+		}
+	}
+}
@@ -7,11 +7,18 @@
 #include <inc/assert.h>
 #include <inc/x86.h>
 #include <inc/uefi.h>
+#include <inc/probe.h>
 
 #include <kern/console.h>
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
 #include <kern/uefi_f.h>
+#include <kern/profile.h>
+#include <kern/tsc.h>
+#include <kern/bench.h>
+#include <kern/gcov.h>
+#include <kern/cpu.h>
+#include <kern/pagecache.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -30,6 +37,15 @@ static struct Command commands[] = {
   {"backtrace", "Print backtrace", mon_backtrace },
   {"lpinfo","print LOAD_PARAMETR info",mon_lpinfo},
   {"PrintMemoryMap","print uefi memory map",mon_GMM},
+  {"memperf", "Time memcpy/memmove/memset from 1B to 8MB [dst offset]", mon_memperf },
+  {"profile", "Sample the kernel: start [hz] | stop | report [rows] | folded", mon_profile },
+  {"probes", "Show PROBE() call counts and cycles [reset]", mon_probes },
+  {"boottime", "Show how long each boot phase took, in microseconds", mon_boottime },
+  {"modules", "List the boot modules the loader passed in", mon_modules },
+  {"bench", "Run microbenchmarks, min/median cycles [list | name ...]", mon_bench },
+  {"gcov", "Dump the profile counters of a PGO=gen kernel to serial", mon_gcov },
+  {"cpus", "List the CPUs and how long each AP took to start", mon_cpus },
+  {"pcache", "Show the per-CPU page caches [drain]", mon_pcache },
 };
 #define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
 
@@ -108,6 +124,203 @@ mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 }
 
 
+// Largest size swept by memperf; also the size of each scratch buffer.
+#define MEMPERF_MAX	(8 << 20)
+
+enum { MEMPERF_MEMCPY, MEMPERF_MEMMOVE, MEMPERF_MEMSET };
+
+// Average nanoseconds for one call of 'op' on n bytes.
+static uint64_t
+memperf_run(int op, char *dst, char *src, size_t n)
+{
+	uint64_t start;
+	uint32_t i, reps;
+
+	// Enough repetitions to cover ~16MB, but at least two and
+	// few enough that the 1-byte case does not take all day.
+	reps = (2 * MEMPERF_MAX) / n;
+	if (reps > 4096)
+		reps = 4096;
+	if (reps < 2)
+		reps = 2;
+
+	start = read_tsc();
+	for (i = 0; i < reps; i++) {
+		if (op == MEMPERF_MEMCPY)
+			memcpy(dst, src, n);
+		else if (op == MEMPERF_MEMMOVE)
+			memmove(dst, src, n);
+		else
+			memset(dst, i, n);
+	}
+	return tsc_to_ns(read_tsc() - start) / reps;
+}
+
+int
+mon_memperf(int argc, char **argv, struct Trapframe *tf)
+{
+	EFI_PHYSICAL_ADDRESS src, dst;
+	UINTN pages;
+	size_t n, off;
+	char *d, *s;
+
+	// An optional destination offset exercises the unaligned head/tail.
+	off = argc > 1 ? strtol(argv[1], NULL, 0) & 3 : 0;
+	pages = MEMPERF_MAX / PGSIZE + 1;
+	if (AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &src) != EFI_SUCCESS) {
+		cprintf("memperf: out of memory\n");
+		return 0;
+	}
+	if (AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &dst) != EFI_SUCCESS) {
+		FreePages(&src, pages);
+		cprintf("memperf: out of memory\n");
+		return 0;
+	}
+	s = (char *) (uint32_t) src;
+	d = (char *) (uint32_t) dst + off;
+	memset(s, 0xA5, MEMPERF_MAX);
+
+	cprintf("ns per call, dst offset %u\n", off);
+	cprintf("%8s %10s %10s %10s\n", "bytes", "memcpy", "memmove", "memset");
+	for (n = 1; n <= MEMPERF_MAX; n <<= 1)
+		cprintf("%8u %10llu %10llu %10llu\n", n,
+			memperf_run(MEMPERF_MEMCPY, d, s, n),
+			memperf_run(MEMPERF_MEMMOVE, d, s, n),
+			memperf_run(MEMPERF_MEMSET, d, s, n));
+
+	FreePages(&dst, pages);
+	FreePages(&src, pages);
+	return 0;
+}
+
+int
+mon_profile(int argc, char **argv, struct Trapframe *tf)
+{
+	uint32_t hz;
+
+	if (argc >= 2 && strcmp(argv[1], "start") == 0) {
+		hz = argc > 2 ? strtol(argv[2], NULL, 0) : PROFILE_HZ;
+		if (hz == 0)
+			hz = PROFILE_HZ;
+		profile_start(hz);
+		cprintf("profiling at %u Hz\n", hz);
+	} else if (argc >= 2 && strcmp(argv[1], "stop") == 0) {
+		profile_stop();
+	} else if (argc >= 2 && strcmp(argv[1], "report") == 0) {
+		profile_report(argc > 2 ? strtol(argv[2], NULL, 0) : 20);
+	} else if (argc >= 2 && strcmp(argv[1], "folded") == 0) {
+		cprintf("%d folded stacks written to serial\n", profile_folded());
+	} else
+		cprintf("usage: profile start [hz] | stop | report [rows] | folded\n");
+	return 0;
+}
+
+extern struct Probe __PROBES_BEGIN__[], __PROBES_END__[];
+
+int
+mon_probes(int argc, char **argv, struct Trapframe *tf)
+{
+	struct Probe *p, *end = __PROBES_END__, snap;
+
+	if (__PROBES_BEGIN__ == end) {
+		cprintf("no probes compiled in (build with CONFIG_PROBES=y)\n");
+		return 0;
+	}
+	if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+		for (p = __PROBES_BEGIN__; p < end; p++)
+			p->p_count = p->p_cycles = p->p_max = 0;
+		return 0;
+	}
+
+	cprintf("%-16s %-20s %10s %14s %10s %10s\n",
+		"function", "site", "calls", "cycles", "mean ns", "max ns");
+	for (p = __PROBES_BEGIN__; p < end; p++) {
+		// cprintf itself is probed; print a stable copy.
+		snap = *p;
+		cprintf("%-16s %14s:%-5d %10llu %14llu %10llu %10llu\n",
+			snap.p_name, snap.p_file, snap.p_line,
+			snap.p_count, snap.p_cycles,
+			snap.p_count ? tsc_to_ns(snap.p_cycles / snap.p_count) : 0,
+			tsc_to_ns(snap.p_max));
+	}
+	return 0;
+}
+
+int
+mon_boottime(int argc, char **argv, struct Trapframe *tf)
+{
+	boot_timing_report();
+	return 0;
+}
+
+int
+mon_modules(int argc, char **argv, struct Trapframe *tf)
+{
+	PrintBootModules();
+	return 0;
+}
+
+int
+mon_bench(int argc, char **argv, struct Trapframe *tf)
+{
+	const char *name;
+	int i = 1, n;
+
+	if (argc >= 2 && strcmp(argv[1], "list") == 0) {
+		bench_list();
+		return 0;
+	}
+	// No names runs the lot.
+	do {
+		name = i < argc ? argv[i] : NULL;
+		if ((n = bench_run(name)) < 0) {
+			cprintf("bench: out of memory\n");
+			return 0;
+		}
+		if (n == 0)
+			cprintf("bench: no benchmark '%s'\n", name);
+	} while (++i < argc);
+	return 0;
+}
+
+int
+mon_gcov(int argc, char **argv, struct Trapframe *tf)
+{
+	int n = gcov_dump();
+
+	if (n < 0)
+		cprintf("no profile counters (build with PGO=gen)\n");
+	else
+		cprintf("%d objects' counters written to serial\n", n);
+	return 0;
+}
+
+int
+mon_cpus(int argc, char **argv, struct Trapframe *tf)
+{
+	struct CpuInfo *c;
+
+	for (c = cpus; c < cpus + ncpu; c++) {
+		cprintf("CPU %d: APIC %d, ", c->cpu_id, c->cpu_apicid);
+		if (c == bootcpu)
+			cprintf("boot CPU\n");
+		else if (c->cpu_status == CPU_STARTED)
+			cprintf("started in %llu us\n", c->cpu_boot_ns / 1000);
+		else
+			cprintf("not running\n");
+	}
+	return 0;
+}
+
+int
+mon_pcache(int argc, char **argv, struct Trapframe *tf)
+{
+	if (argc >= 2 && strcmp(argv[1], "drain") == 0)
+		page_cache_drain();
+	page_cache_print();
+	return 0;
+}
+
 
 /***** Kernel monitor command interpreter *****/
 
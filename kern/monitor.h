@@ -18,5 +18,14 @@ int mon_backtrace(int argc, char **argv, struct Trapframe *tf);
 int mon_lpinfo(int argc, char **argv, struct Trapframe *tf);
 int mon_firestarter(int argc, char **argv, struct Trapframe *tf);
 int mon_GMM(int argc, char **argv, struct Trapframe *tf);
+int mon_memperf(int argc, char **argv, struct Trapframe *tf);
+int mon_profile(int argc, char **argv, struct Trapframe *tf);
+int mon_probes(int argc, char **argv, struct Trapframe *tf);
+int mon_boottime(int argc, char **argv, struct Trapframe *tf);
+int mon_modules(int argc, char **argv, struct Trapframe *tf);
+int mon_bench(int argc, char **argv, struct Trapframe *tf);
+int mon_gcov(int argc, char **argv, struct Trapframe *tf);
+int mon_cpus(int argc, char **argv, struct Trapframe *tf);
+int mon_pcache(int argc, char **argv, struct Trapframe *tf);
 
 #endif	// !JOS_KERN_MONITOR_H
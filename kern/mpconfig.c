@@ -0,0 +1,113 @@
+/* See COPYRIGHT for copyright information. */
+
+// Find the processors from the ACPI MADT.  The MP specification's
+// floating pointer and configuration table live in legacy BIOS areas
+// that UEFI firmware needn't provide, while every firmware that can
+// start more than one CPU describes them in the MADT.
+
+#include <inc/types.h>
+#include <inc/string.h>
+#include <inc/memlayout.h>
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/stdio.h>
+
+#include <kern/acpi.h>
+#include <kern/cpu.h>
+
+struct CpuInfo cpus[NCPU];
+struct CpuInfo *bootcpu;
+int ncpu;
+
+// Per-CPU kernel stacks
+unsigned char percpu_kstacks[NCPU][KSTKSIZE]
+__attribute__ ((aligned(PGSIZE)));
+
+// The CPU we're running on.  Each AP runs on its own stack in
+// percpu_kstacks and the boot CPU on none of them, so the stack
+// pointer tells, without reading the local APIC's ID, which is an
+// uncached MMIO load.
+int
+cpunum(void)
+{
+	uint32_t esp = read_esp();
+
+	if (esp > (uint32_t) percpu_kstacks &&
+	    esp <= (uint32_t) percpu_kstacks + sizeof(percpu_kstacks))
+		return (esp - 1 - (uint32_t) percpu_kstacks) / KSTKSIZE;
+	return bootcpu ? bootcpu->cpu_id : 0;
+}
+
+// The initial APIC ID of the CPU we're running on, from cpuid, which
+// works before the local APIC is mapped.
+static uint8_t
+cpuid_apicid(void)
+{
+	uint32_t ebx;
+
+	cpuid(1, NULL, &ebx, NULL, NULL);
+	return ebx >> 24;
+}
+
+void
+mp_init(void)
+{
+	struct AcpiMadt *madt;
+	struct AcpiMadtLapic *proc;
+	uint8_t *p, *end, me;
+
+	me = cpuid_apicid();
+	if (!(madt = acpi_find_table("APIC"))) {
+		cprintf("SMP: no MADT, running on one CPU\n");
+		goto single;
+	}
+	lapicaddr = madt->lapic_addr;
+
+	end = (uint8_t *) madt + madt->h.length;
+	for (p = (uint8_t *) (madt + 1); p + 2 <= end && p[1] >= 2; p += p[1]) {
+		switch (p[0]) {
+		case ACPI_MADT_LAPIC:
+			proc = (struct AcpiMadtLapic *) p;
+			if (!(proc->flags & ACPI_MADT_ENABLED))
+				continue;
+			if (ncpu < NCPU) {
+				cpus[ncpu].cpu_id = ncpu;
+				cpus[ncpu].cpu_apicid = proc->apic_id;
+				if (proc->apic_id == me)
+					bootcpu = &cpus[ncpu];
+				ncpu++;
+			} else
+				cprintf("SMP: too many CPUs, CPU %d disabled\n",
+					proc->apic_id);
+			continue;
+		case ACPI_MADT_LAPIC_ADDR:
+			// We run with 32-bit physical addresses
+			if (((struct AcpiMadtLapicAddr *) p)->lapic_addr >> 32)
+				cprintf("SMP: local APIC above 4GB, ignored\n");
+			else
+				lapicaddr = ((struct AcpiMadtLapicAddr *) p)->lapic_addr;
+			continue;
+		default:
+			// I/O APICs, interrupt overrides and x2APIC
+			// entries: we leave interrupts on the 8259A and
+			// only start CPUs with 8-bit APIC IDs.
+			continue;
+		}
+	}
+
+	if (bootcpu) {
+		bootcpu->cpu_status = CPU_STARTED;
+		cprintf("SMP: CPU %d found %d CPU(s)\n", bootcpu->cpu_id, ncpu);
+		return;
+	}
+	cprintf("SMP: boot CPU not in the MADT, running on one CPU\n");
+
+single:
+	// Remember the BSP so cpunum() still works, but start nothing.
+	memset(cpus, 0, sizeof(cpus));
+	ncpu = 1;
+	cpus[0].cpu_apicid = me;
+	cpus[0].cpu_status = CPU_STARTED;
+	bootcpu = &cpus[0];
+	lapicaddr = 0;
+}
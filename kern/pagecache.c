@@ -0,0 +1,134 @@
+/* See COPYRIGHT for copyright information. */
+
+// Per-CPU caches of single pages in front of AllocatePages().
+//
+// page_alloc() and page_free() hand out and take back one page of
+// EfiLoaderData at a time.  Each CPU keeps a stack of up to
+// PCACHE_SIZE free pages that only it touches, with interrupts off,
+// so the common case takes no lock and walks no page map.  An empty
+// cache is refilled, and a full one drained, PCACHE_BATCH pages at a
+// time by AllocatePageBatch() and FreePageBatch(), which take the
+// page map's lock once per batch.
+//
+// Pages sitting in a cache are EfiLoaderData in the page map, like
+// pages in use; page_cache_drain() gives them back.
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/error.h>
+#include <inc/x86.h>
+
+#include <kern/cpu.h>
+#include <kern/pagecache.h>
+#include <kern/uefi_f.h>
+
+struct PageCache {
+	uint32_t count;			// pages[0..count) are free
+	EFI_PHYSICAL_ADDRESS pages[PCACHE_SIZE];
+	uint32_t refills, drains;	// batches to and from AllocatePages
+	uint64_t allocs, frees;
+} __attribute__((aligned(64)));	// a cache line each, so CPUs don't share
+
+static struct PageCache pcaches[NCPU];
+
+// This CPU's cache, with interrupts off until pcache_put.  Nothing
+// else runs on this CPU meanwhile, and no other CPU touches it.
+static struct PageCache *
+pcache_get(uint32_t *eflags)
+{
+	*eflags = read_eflags();
+	asm volatile("cli");
+	return &pcaches[cpunum()];
+}
+
+static void
+pcache_put(uint32_t eflags)
+{
+	write_eflags(eflags);
+}
+
+// Allocate a page.  Returns 0 on success, < 0 if memory is out.
+int
+page_alloc(EFI_PHYSICAL_ADDRESS *pa)
+{
+	struct PageCache *pc;
+	uint32_t eflags;
+	int r = 0;
+
+	pc = pcache_get(&eflags);
+	if (pc->count == 0) {
+		pc->count = AllocatePageBatch(EfiLoaderData, pc->pages, PCACHE_BATCH);
+		pc->refills++;
+	}
+	if (pc->count == 0)
+		r = -E_NO_MEM;
+	else {
+		*pa = pc->pages[--pc->count];
+		pc->allocs++;
+	}
+	pcache_put(eflags);
+	return r;
+}
+
+// Free a page from page_alloc().
+void
+page_free(EFI_PHYSICAL_ADDRESS pa)
+{
+	struct PageCache *pc;
+	uint32_t eflags;
+
+	pc = pcache_get(&eflags);
+	if (pc->count == PCACHE_SIZE) {
+		// Give back the bottom of the stack, the pages freed
+		// longest ago and so least likely to be in the CPU cache.
+		FreePageBatch(pc->pages, PCACHE_BATCH);
+		memmove(pc->pages, pc->pages + PCACHE_BATCH,
+			(PCACHE_SIZE - PCACHE_BATCH) * sizeof(pc->pages[0]));
+		pc->count -= PCACHE_BATCH;
+		pc->drains++;
+	}
+	pc->pages[pc->count++] = pa;
+	pc->frees++;
+	pcache_put(eflags);
+}
+
+// Give every page in this CPU's cache back to AllocatePages().
+static void
+pcache_drain(void *arg)
+{
+	struct PageCache *pc;
+	uint32_t eflags;
+
+	pc = pcache_get(&eflags);
+	if (pc->count) {
+		FreePageBatch(pc->pages, pc->count);
+		pc->count = 0;
+		pc->drains++;
+	}
+	pcache_put(eflags);
+}
+
+// Empty every running CPU's cache.  Each CPU drains its own, so
+// this waits for the others to run pcache_drain.
+void
+page_cache_drain(void)
+{
+	struct CpuInfo *c;
+
+	for (c = cpus; c < cpus + ncpu; c++)
+		if (cpu_call(c, pcache_drain, NULL) == 0)
+			cpu_call_wait(c);
+	pcache_drain(NULL);
+}
+
+void
+page_cache_print(void)
+{
+	int i;
+
+	cprintf("CPU  cached   refills    drains          allocs           frees\n");
+	for (i = 0; i < ncpu; i++)
+		cprintf("%3d %7u %9u %9u %15llu %15llu\n", i, pcaches[i].count,
+			pcaches[i].refills, pcaches[i].drains,
+			pcaches[i].allocs, pcaches[i].frees);
+}
@@ -0,0 +1,20 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PAGECACHE_H
+#define JOS_KERN_PAGECACHE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/uefi.h>
+
+#define PCACHE_SIZE		64	// pages a CPU's cache holds at most
+#define PCACHE_BATCH		16	// pages moved per refill or drain
+
+int page_alloc(EFI_PHYSICAL_ADDRESS *pa);
+void page_free(EFI_PHYSICAL_ADDRESS pa);
+void page_cache_drain(void);
+void page_cache_print(void);
+
+#endif	// !JOS_KERN_PAGECACHE_H
@@ -0,0 +1,32 @@
+/* See COPYRIGHT for copyright information. */
+
+#include <inc/x86.h>
+#include <inc/trap.h>
+
+#include <kern/pit.h>
+#include <kern/picirq.h>
+
+// Program PIT channel 0 to interrupt at roughly 'hz' times a second
+// and unmask IRQ 0.  Interrupts still have to be enabled with sti.
+void
+pit_start(uint32_t hz)
+{
+	uint32_t divisor;
+
+	divisor = PIT_FREQ / hz;
+	if (divisor < 2)
+		divisor = 2;
+	if (divisor > 0xFFFF)
+		divisor = 0;		// 0 means 65536
+	outb(PIT_MODE, PIT_SEL_CH0 | PIT_LOHI | PIT_RATEGEN);
+	outb(PIT_CH0, divisor & 0xFF);
+	outb(PIT_CH0, divisor >> 8);
+	irq_enable(IRQ_TIMER);
+}
+
+// Mask IRQ 0 again.  The counter keeps running but nobody listens.
+void
+pit_stop(void)
+{
+	irq_disable(IRQ_TIMER);
+}
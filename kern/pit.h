@@ -0,0 +1,34 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PIT_H
+#define JOS_KERN_PIT_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Intel 8253/8254 programmable interval timer
+#define PIT_FREQ	1193182		// input clock, Hz
+
+#define PIT_CH0		0x40		// channel 0 counter (IRQ 0)
+#define PIT_CH2		0x42		// channel 2 counter (speaker gate)
+#define PIT_MODE	0x43		// mode/command register
+
+#define PIT_SEL_CH0	0x00		// select channel 0
+#define PIT_SEL_CH2	0x80		// select channel 2
+#define PIT_LOHI	0x30		// access low byte, then high byte
+#define PIT_RATEGEN	0x04		// mode 2: rate generator
+#define PIT_ONESHOT	0x00		// mode 0: interrupt on terminal count
+
+// Channel 2's gate and output are wired to the keyboard controller's
+// port B rather than the PIC, so it can be polled with interrupts off.
+#define PIT_PORTB	0x61
+#define PIT_PORTB_GATE2	0x01		// channel 2 gate input
+#define PIT_PORTB_SPKR	0x02		// speaker data enable
+#define PIT_PORTB_OUT2	0x20		// channel 2 output (read only)
+
+void pit_start(uint32_t hz);
+void pit_stop(void);
+
+#endif	// !JOS_KERN_PIT_H
@@ -0,0 +1,226 @@
+// Statistical sampling profiler.
+//
+// PIT channel 0 interrupts the kernel PROFILE_HZ times a second; each
+// tick records the interrupted EIP plus a short frame-pointer backtrace
+// into a preallocated buffer.  Reports are built afterwards by
+// symbolizing the samples through debuginfo_eip().
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/memlayout.h>
+#include <inc/trap.h>
+#include <inc/x86.h>
+
+#include <kern/console.h>
+#include <kern/kdebug.h>
+#include <kern/pit.h>
+#include <kern/profile.h>
+
+struct ProfSample {
+	uintptr_t ps_pc[PROFILE_DEPTH];	// ps_pc[0] is the sampled EIP;
+					// unused slots are 0
+};
+
+struct ProfFunc {
+	uintptr_t pf_addr;		// function start, 0 for unknown
+	const char *pf_name;
+	int pf_namelen;
+	uint32_t pf_self;		// samples with this function as leaf
+	uint32_t pf_total;		// samples with it anywhere on the stack
+};
+
+static struct ProfSample samples[PROFILE_NSAMPLES];
+static volatile uint32_t nsamples;
+static volatile uint32_t ndropped;
+static volatile bool profiling;
+
+static struct ProfFunc funcs[PROFILE_NFUNCS];
+
+void
+profile_start(uint32_t hz)
+{
+	nsamples = 0;
+	ndropped = 0;
+	profiling = 1;
+	pit_start(hz);
+	asm volatile("sti");
+}
+
+void
+profile_stop(void)
+{
+	asm volatile("cli");
+	pit_stop();
+	profiling = 0;
+}
+
+// Called from the timer interrupt.  Walks the interrupted code's
+// saved-ebp chain; a frame is only followed if it lies above the
+// previous one and within a kernel stack's size of it, so a garbage
+// ebp (e.g. a sample taken inside a function prologue) ends the walk
+// instead of faulting.
+void
+profile_tick(struct Trapframe *tf)
+{
+	uintptr_t *pc, prev, ebp;
+	int i;
+
+	if (!profiling)
+		return;
+	if (nsamples >= PROFILE_NSAMPLES) {
+		ndropped++;
+		return;
+	}
+
+	pc = samples[nsamples++].ps_pc;
+	pc[0] = tf->tf_eip;
+	prev = (uintptr_t) tf;
+	ebp = tf->tf_regs.reg_ebp;
+	for (i = 1; i < PROFILE_DEPTH; i++) {
+		if (ebp <= prev || ebp - prev >= KSTKSIZE || ebp % 4)
+			break;
+		pc[i] = ((uintptr_t *) ebp)[1];
+		prev = ebp;
+		ebp = ((uintptr_t *) ebp)[0];
+	}
+	for (; i < PROFILE_DEPTH; i++)
+		pc[i] = 0;
+}
+
+// Symbolize 'pc'.  Return addresses point after the call, so callers
+// (depth > 0) are looked up at pc - 1 to land on the call itself.
+// All addresses outside known functions share one "<unknown>" entry.
+static void
+profile_symbolize(uintptr_t pc, int depth, struct Eipdebuginfo *info)
+{
+	debuginfo_eip(depth ? pc - 1 : pc, info);
+	if (info->eip_fn_namelen == 9 &&
+	    strncmp(info->eip_fn_name, "<unknown>", 9) == 0)
+		info->eip_fn_addr = 0;
+}
+
+static struct ProfFunc *
+profile_func(struct Eipdebuginfo *info)
+{
+	uint32_t h = (info->eip_fn_addr >> 2) % PROFILE_NFUNCS;
+	int i;
+
+	for (i = 0; i < PROFILE_NFUNCS; i++, h = (h + 1) % PROFILE_NFUNCS) {
+		if (funcs[h].pf_name == NULL) {
+			funcs[h].pf_addr = info->eip_fn_addr;
+			funcs[h].pf_name = info->eip_fn_name;
+			funcs[h].pf_namelen = info->eip_fn_namelen;
+			return &funcs[h];
+		}
+		if (funcs[h].pf_addr == info->eip_fn_addr)
+			return &funcs[h];
+	}
+	return NULL;
+}
+
+// Print a flat profile: functions sorted by samples in which they were
+// the leaf (self), with the number of samples they appeared in at all.
+void
+profile_report(int maxrows)
+{
+	struct Eipdebuginfo info;
+	struct ProfFunc *f, *seen[PROFILE_DEPTH], tmp;
+	uint32_t n, i, j, k, nfuncs, lost = 0;
+
+	if (profiling) {
+		cprintf("profile: still running, stop it first\n");
+		return;
+	}
+	n = nsamples;
+	if (n == 0) {
+		cprintf("profile: no samples\n");
+		return;
+	}
+
+	memset(funcs, 0, sizeof(funcs));
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < PROFILE_DEPTH && samples[i].ps_pc[j]; j++) {
+			profile_symbolize(samples[i].ps_pc[j], j, &info);
+			if ((f = profile_func(&info)) == NULL) {
+				lost++;
+				break;
+			}
+			if (j == 0)
+				f->pf_self++;
+			// Count recursive functions once per sample.
+			for (k = 0; k < j && seen[k] != f; k++)
+				/* do nothing */;
+			if (k == j)
+				f->pf_total++;
+			seen[j] = f;
+		}
+	}
+
+	// Compact the hash table and insertion-sort it by self count.
+	for (i = nfuncs = 0; i < PROFILE_NFUNCS; i++)
+		if (funcs[i].pf_name)
+			funcs[nfuncs++] = funcs[i];
+	for (i = 1; i < nfuncs; i++) {
+		tmp = funcs[i];
+		for (j = i; j > 0 && (funcs[j-1].pf_self < tmp.pf_self ||
+		     (funcs[j-1].pf_self == tmp.pf_self &&
+		      funcs[j-1].pf_total < tmp.pf_total)); j--)
+			funcs[j] = funcs[j-1];
+		funcs[j] = tmp;
+	}
+
+	cprintf("%u samples", n);
+	if (ndropped)
+		cprintf(", %u dropped (buffer full)", ndropped);
+	if (lost)
+		cprintf(", %u stacks truncated (too many functions)", lost);
+	cprintf("\n  self%%    self   total  function\n");
+	for (i = 0; i < nfuncs && (maxrows <= 0 || i < maxrows); i++)
+		cprintf("%5u.%u%% %7u %7u  %.*s\n",
+			funcs[i].pf_self * 100 / n,
+			funcs[i].pf_self * 1000 / n % 10,
+			funcs[i].pf_self, funcs[i].pf_total,
+			funcs[i].pf_namelen, funcs[i].pf_name);
+
+	// funcs[] is no longer a hash table.
+	memset(funcs, 0, sizeof(funcs));
+}
+
+static void
+serial_putch(int ch, void *unused)
+{
+	serial_putc(ch);
+}
+
+// Write the samples to the serial port in the "folded" format used by
+// flamegraph.pl and friends: one "outer;...;leaf count" line per stack,
+// between BEGIN/END marker lines so the host can cut them out of the log.
+// Identical consecutive stacks are merged.  Returns the number of lines.
+int
+profile_folded(void)
+{
+	struct Eipdebuginfo info;
+	uint32_t n, i, count;
+	int j, depth, lines = 0;
+
+	n = nsamples;
+	printfmt(serial_putch, NULL, "# BEGIN folded stacks\n");
+	for (i = 0; i < n; i += count) {
+		for (count = 1; i + count < n &&
+		     memcmp(&samples[i], &samples[i + count],
+			    sizeof(samples[i])) == 0; count++)
+			/* do nothing */;
+		for (depth = 0; depth < PROFILE_DEPTH && samples[i].ps_pc[depth]; depth++)
+			/* do nothing */;
+		for (j = depth - 1; j >= 0; j--) {
+			profile_symbolize(samples[i].ps_pc[j], j, &info);
+			printfmt(serial_putch, NULL, "%.*s%c",
+				 info.eip_fn_namelen, info.eip_fn_name,
+				 j ? ';' : ' ');
+		}
+		printfmt(serial_putch, NULL, "%u\n", count);
+		lines++;
+	}
+	printfmt(serial_putch, NULL, "# END folded stacks\n");
+	return lines;
+}
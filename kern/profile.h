@@ -0,0 +1,24 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PROFILE_H
+#define JOS_KERN_PROFILE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+struct Trapframe;
+
+#define PROFILE_HZ		1000	// default sampling rate
+#define PROFILE_DEPTH		8	// PCs recorded per sample, leaf first
+#define PROFILE_NSAMPLES	8192	// samples kept before dropping
+#define PROFILE_NFUNCS		512	// distinct functions in a report
+
+void profile_start(uint32_t hz);
+void profile_stop(void);
+void profile_tick(struct Trapframe *tf);
+void profile_report(int maxrows);
+int profile_folded(void);
+
+#endif	// !JOS_KERN_PROFILE_H
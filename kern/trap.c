@@ -0,0 +1,158 @@
+#include <inc/mmu.h>
+#include <inc/x86.h>
+#include <inc/assert.h>
+
+#include <kern/trap.h>
+#include <kern/console.h>
+#include <kern/monitor.h>
+#include <kern/picirq.h>
+#include <kern/profile.h>
+#include <kern/cpu.h>
+
+/* Interrupt descriptor table.  (Must be built at run time because
+ * shifted function addresses can't be represented in relocation records.)
+ */
+struct Gatedesc idt[256] = { { 0 } };
+struct Pseudodesc idt_pd = {
+	sizeof(idt) - 1, (uint32_t) idt
+};
+
+
+static const char *trapname(int trapno)
+{
+	static const char * const excnames[] = {
+		"Divide error",
+		"Debug",
+		"Non-Maskable Interrupt",
+		"Breakpoint",
+		"Overflow",
+		"BOUND Range Exceeded",
+		"Invalid Opcode",
+		"Device Not Available",
+		"Double Fault",
+		"Coprocessor Segment Overrun",
+		"Invalid TSS",
+		"Segment Not Present",
+		"Stack Fault",
+		"General Protection",
+		"Page Fault",
+		"(unknown trap)",
+		"x87 FPU Floating-Point Error",
+		"Alignment Check",
+		"Machine-Check",
+		"SIMD Floating-Point Exception"
+	};
+
+	if (trapno < sizeof(excnames)/sizeof(excnames[0]))
+		return excnames[trapno];
+	if (trapno >= IRQ_OFFSET && trapno < IRQ_OFFSET + 16)
+		return "Hardware Interrupt";
+	return "(unknown trap)";
+}
+
+
+void
+trap_init(void)
+{
+	extern void th_divide(), th_debug(), th_nmi(), th_brkpt(), th_oflow(),
+		th_bound(), th_illop(), th_device(), th_dblflt(), th_tss(),
+		th_segnp(), th_stack(), th_gpflt(), th_pgflt(), th_fperr(),
+		th_align(), th_mchk(), th_simderr(),
+		th_irq_timer(), th_irq_spurious(), th_irq_ipi();
+	uint16_t cs;
+
+	// We still run on the code segment the loader left us in;
+	// point every gate at it rather than at a GDT of our own.
+	asm volatile("movw %%cs,%0" : "=r" (cs));
+
+	SETGATE(idt[T_DIVIDE], 0, cs, th_divide, 0);
+	SETGATE(idt[T_DEBUG], 0, cs, th_debug, 0);
+	SETGATE(idt[T_NMI], 0, cs, th_nmi, 0);
+	SETGATE(idt[T_BRKPT], 0, cs, th_brkpt, 0);
+	SETGATE(idt[T_OFLOW], 0, cs, th_oflow, 0);
+	SETGATE(idt[T_BOUND], 0, cs, th_bound, 0);
+	SETGATE(idt[T_ILLOP], 0, cs, th_illop, 0);
+	SETGATE(idt[T_DEVICE], 0, cs, th_device, 0);
+	SETGATE(idt[T_DBLFLT], 0, cs, th_dblflt, 0);
+	SETGATE(idt[T_TSS], 0, cs, th_tss, 0);
+	SETGATE(idt[T_SEGNP], 0, cs, th_segnp, 0);
+	SETGATE(idt[T_STACK], 0, cs, th_stack, 0);
+	SETGATE(idt[T_GPFLT], 0, cs, th_gpflt, 0);
+	SETGATE(idt[T_PGFLT], 0, cs, th_pgflt, 0);
+	SETGATE(idt[T_FPERR], 0, cs, th_fperr, 0);
+	SETGATE(idt[T_ALIGN], 0, cs, th_align, 0);
+	SETGATE(idt[T_MCHK], 0, cs, th_mchk, 0);
+	SETGATE(idt[T_SIMDERR], 0, cs, th_simderr, 0);
+
+	SETGATE(idt[IRQ_OFFSET + IRQ_TIMER], 0, cs, th_irq_timer, 0);
+	SETGATE(idt[IRQ_OFFSET + IRQ_SPURIOUS], 0, cs, th_irq_spurious, 0);
+	SETGATE(idt[IRQ_OFFSET + IRQ_IPI], 0, cs, th_irq_ipi, 0);
+
+	// Per-CPU setup
+	trap_init_percpu();
+}
+
+// Initialize and load the per-CPU IDT register.
+void
+trap_init_percpu(void)
+{
+	lidt(&idt_pd);
+}
+
+void
+print_trapframe(struct Trapframe *tf)
+{
+	cprintf("TRAP frame at %p\n", tf);
+	print_regs(&tf->tf_regs);
+	cprintf("  es   0x----%04x\n", tf->tf_es);
+	cprintf("  ds   0x----%04x\n", tf->tf_ds);
+	cprintf("  trap 0x%08x %s\n", tf->tf_trapno, trapname(tf->tf_trapno));
+	if (tf->tf_trapno == T_PGFLT)
+		cprintf("  cr2  0x%08x\n", rcr2());
+	cprintf("  err  0x%08x\n", tf->tf_err);
+	cprintf("  eip  0x%08x\n", tf->tf_eip);
+	cprintf("  cs   0x----%04x\n", tf->tf_cs);
+	cprintf("  flag 0x%08x\n", tf->tf_eflags);
+}
+
+void
+print_regs(struct PushRegs *regs)
+{
+	cprintf("  edi  0x%08x\n", regs->reg_edi);
+	cprintf("  esi  0x%08x\n", regs->reg_esi);
+	cprintf("  ebp  0x%08x\n", regs->reg_ebp);
+	cprintf("  oesp 0x%08x\n", regs->reg_oesp);
+	cprintf("  ebx  0x%08x\n", regs->reg_ebx);
+	cprintf("  edx  0x%08x\n", regs->reg_edx);
+	cprintf("  ecx  0x%08x\n", regs->reg_ecx);
+	cprintf("  eax  0x%08x\n", regs->reg_eax);
+}
+
+void
+trap(struct Trapframe *tf)
+{
+	switch (tf->tf_trapno) {
+	case IRQ_OFFSET + IRQ_TIMER:
+		profile_tick(tf);
+		irq_eoi(IRQ_TIMER);
+		return;
+
+	case IRQ_OFFSET + IRQ_SPURIOUS:
+		// The 8259 raises IRQ 7 for interrupts that went away
+		// before it could deliver them.  Nothing to acknowledge.
+		return;
+
+	case IRQ_OFFSET + IRQ_IPI:
+		// Only wakes an AP's idle loop, which runs the call.
+		lapic_eoi();
+		return;
+
+	case T_BRKPT:
+		monitor(tf);
+		return;
+	}
+
+	// Everything else is a kernel bug.
+	print_trapframe(tf);
+	panic("unhandled trap in kernel");
+}
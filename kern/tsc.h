@@ -0,0 +1,24 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_TSC_H
+#define JOS_KERN_TSC_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+#define TSC_CALIBRATE_MS	10	// PIT interval the TSC is counted over
+
+void tsc_init(void);
+uint64_t tsc_per_ms(void);
+const char *tsc_source(void);
+bool tsc_invariant(void);
+uint64_t tsc_to_us(uint64_t ticks);
+uint64_t tsc_to_ns(uint64_t ticks);
+uint64_t ktime_ns(void);
+void boot_stamp(uint32_t id, uint64_t tsc);
+void boot_marker(const char *name, uint64_t tsc);
+int boot_timing_report(void);
+
+#endif	// !JOS_KERN_TSC_H
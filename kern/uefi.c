@@ -1,7 +1,9 @@
 #include "inc/uefi.h"
 #include <inc/stdio.h>
 #include <inc/string.h>
+#include <inc/probe.h>
 #include <kern/uefi_f.h>
+#include <kern/spinlock.h>
 
 const char * memory_types[] = 
 {
@@ -31,63 +33,164 @@ const char * alocate_types[] =
     "MaxAllocateType",
 };
 
-#define LP_pointer 0x1EB9EC90 // Realizaation For -m 512 
-// if -m 512 : 0x1EB9EC90
-// if -m 128 : 0x06B9EC90
-// if -m 1024: 0x3EB9EC90
-// so i think we can't know it ?
 #define SPAGES 4096
 
 
 LOADER_PARAMS * UEFI_LP;
 
+// Taken by AllocatePages(), FreePages() and the batch versions the
+// per-CPU page caches use, once other CPUs are running.
+static struct spinlock page_lock;
+
 uint64_t AVAIBLE_MEMORY;
 uint64_t MEMORY_MAP_SIZE;
 uint64_t MEMORY_MAP_ADDR;
 
 
+// Number of entries in the loader's coalesced memory map, 0 if it
+// didn't build one or is too old to know about it.
+static uint32_t
+loader_range_count()
+{
+    if (!LOADER_PARAMS_HAS(UEFI_LP, LOADER_MEMORY_RANGES))
+        return 0;
+    return UEFI_LP->Number_of_Memory_Ranges;
+}
+
+// Number of ranges memory_range() can return.
+static uint32_t
+memory_range_count()
+{
+    if (loader_range_count())
+        return loader_range_count();
+    return UEFI_LP->Memory_Map_Size / UEFI_LP->Memory_Map_Descriptor_Size;
+}
+
+// Range i of the loader's coalesced memory map, or of the raw firmware
+// map if the loader couldn't build one.  The raw map isn't guaranteed
+// to be sorted; init_memory_map() skips anything out of order.
+static void
+memory_range(uint32_t i, MEMORY_RANGE *r)
+{
+    if (loader_range_count())
+    {
+        *r = UEFI_LP->Memory_Ranges[i];
+        return;
+    }
+
+    EFI_MEMORY_DESCRIPTOR *desc = (EFI_MEMORY_DESCRIPTOR *)((uint8_t *)UEFI_LP->Memory_Map +
+            i * UEFI_LP->Memory_Map_Descriptor_Size);
+    r->PhysicalStart = desc->PhysicalStart;
+    r->NumberOfPages = desc->NumberOfPages;
+    r->Type = desc->Type;
+    r->Flags = (desc->Type == EfiBootServicesCode || desc->Type == EfiBootServicesData) ?
+            MEMORY_RANGE_RECLAIMABLE : 0;
+}
 
+// Free for us to allocate: conventional memory, and boot services
+// memory now that the firmware is done with it.
+static int
+memory_range_free(const MEMORY_RANGE *r)
+{
+    return r->Type == EfiConventionalMemory || (r->Flags & MEMORY_RANGE_RECLAIMABLE);
+}
+
+// Is there RAM behind this range (as opposed to MMIO, reserved holes
+// and the like)?
+static int
+memory_range_ram(const MEMORY_RANGE *r)
+{
+    switch (r->Type)
+    {
+    case EfiLoaderCode:
+    case EfiLoaderData:
+    case EfiBootServicesCode:
+    case EfiBootServicesData:
+    case EfiRuntimeServicesCode:
+    case EfiRuntimeServicesData:
+    case EfiConventionalMemory:
+    case EfiACPIReclaimMemory:
+    case EfiACPIMemoryNVS:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Write one single-page descriptor for each page in [start, end) at
+// 'out' and return where the next one goes.  The pages holding the
+// page map itself are marked EfiMaxMemoryType so they never get handed
+// out.
+static uint8_t *
+describe_pages(uint8_t *out, uint64_t start, uint64_t end, uint32_t type)
+{
+    uint64_t map_end = MEMORY_MAP_ADDR + (MEMORY_MAP_SIZE + SPAGES - 1) / SPAGES * SPAGES;
+
+    for (; start < end; start += SPAGES)
+    {
+        EFI_MEMORY_DESCRIPTOR *desc = (EFI_MEMORY_DESCRIPTOR *)out;
+
+        desc->Type = type;
+        if (type == EfiConventionalMemory && start >= MEMORY_MAP_ADDR && start < map_end)
+            desc->Type = EfiMaxMemoryType;
+        desc->PhysicalStart = start;
+        desc->VirtualStart = 0;
+        desc->NumberOfPages = 1;
+        desc->Attribute = 0;
+        out += UEFI_LP->Memory_Map_Descriptor_Size;
+    }
+    return out;
+}
+
+// Build the page map AllocatePages() and FreePages() work on: one
+// descriptor per page from 0 up to the top of RAM, so page p is entry
+// p.  Everything but the writing of the page map itself is one pass
+// over the loader's coalesced ranges.
 int init_memory_map()
 {
-    UEFI_LP=(void *)LP_pointer;
-    uint8_t * MemoryMapPointer = (uint8_t * )UEFI_LP->Memory_Map +
-            UEFI_LP->Memory_Map_Size - UEFI_LP->Memory_Map_Descriptor_Size ;
-    //point into last element in memory_map    
+    uint32_t nranges;
+    MEMORY_RANGE r;
+    uint32_t i;
 
-    EFI_MEMORY_DESCRIPTOR *desc = (EFI_MEMORY_DESCRIPTOR *)MemoryMapPointer;
+    spin_initlock(&page_lock);
 
-                // cprintf("  Type: %u,  %s \n", desc->Type,memory_types[desc->Type]); 
-                // cprintf("  PhysicalStart: %016llx\n", desc->PhysicalStart);
-                // cprintf("  VirtualStart: %016llx\n", desc->VirtualStart);  
-                // cprintf("  NumberOfPages: %016llx   (4k)\n", desc->NumberOfPages);
-                // cprintf("  Attribute: %016llx\n", desc->Attribute);  
-                /// Test May Be useful
+    // The legacy boot loader passes no memory map: leave the page map
+    // empty, so AllocatePages() has nothing to hand out.
+    if (!UEFI_LP)
+    {
+        AVAIBLE_MEMORY = 0;
+        MEMORY_MAP_SIZE = 0;
+        MEMORY_MAP_ADDR = 0;
+        cprintf("  No memory map from the loader\n");
+        return 0;
+    }
+    nranges = memory_range_count();
 
-    //struct point
+    // The top of RAM (not of MMIO or reserved holes, which may sit far above it)
+    AVAIBLE_MEMORY = 0;
+    for (i = 0; i < nranges; i++)
+    {
+        memory_range(i, &r);
+        if (memory_range_ram(&r) && r.PhysicalStart + r.NumberOfPages * SPAGES > AVAIBLE_MEMORY)
+            AVAIBLE_MEMORY = r.PhysicalStart + r.NumberOfPages * SPAGES;
+    }
 
-    AVAIBLE_MEMORY = desc->PhysicalStart + desc->NumberOfPages * SPAGES; // Avaible memory for working;
     MEMORY_MAP_SIZE = AVAIBLE_MEMORY / SPAGES * UEFI_LP->Memory_Map_Descriptor_Size;
     cprintf("  We have around : %016llx\n", AVAIBLE_MEMORY );
     cprintf("  We lost around : %016llx\n", MEMORY_MAP_SIZE);
     cprintf("  We lost pages around : %016llx\n", MEMORY_MAP_SIZE/UEFI_LP->Memory_Map_Descriptor_Size);
     // Now We Must Find place for new Memory Map 
 
-    uint8_t * startOfMemoryMap = (void *)UEFI_LP->Memory_Map;
-    uint8_t * endOfMemoryMap   = startOfMemoryMap + UEFI_LP->Memory_Map_Size;
-    uint8_t * offset           = startOfMemoryMap;
-    //cprintf("Memory_Map_Size pointer addr %p\r\n", UEFI_LP->Memory_Map); 
-
-    while (offset < endOfMemoryMap)
+    MEMORY_MAP_ADDR = 0;
+    for (i = 0; i < nranges; i++)
     {
-        EFI_MEMORY_DESCRIPTOR *desc = (EFI_MEMORY_DESCRIPTOR *)(offset);
-        // cprintf(" C: Type: %u,  %s \n", desc->Type,memory_types[desc->Type]);
-        if ( (desc->Type == EfiConventionalMemory) && ( desc->NumberOfPages >  MEMORY_MAP_SIZE / SPAGES) )
+        memory_range(i, &r);
+        if (memory_range_free(&r) && r.NumberOfPages * SPAGES >= MEMORY_MAP_SIZE)
         {
-            MEMORY_MAP_ADDR = desc->PhysicalStart;
+            MEMORY_MAP_ADDR = r.PhysicalStart;
             break;
-        }    
-        offset += UEFI_LP->Memory_Map_Descriptor_Size;
-    }    
+        }
+    }
 
     cprintf("  We find around : %016llx\n", MEMORY_MAP_ADDR);
 
@@ -99,31 +202,30 @@ int init_memory_map()
        uint8_t * LowBorder = (uint8_t * ) DungerousPlace;
      
     //***********************************************//
-    
-    startOfMemoryMap = (void *)UEFI_LP->Memory_Map;
-    endOfMemoryMap   = startOfMemoryMap + UEFI_LP->Memory_Map_Size;
-    offset           = startOfMemoryMap;
+
     uint8_t * memmap_offset = LowBorder;
-    uint64_t  memadr_offset = 0;
+    uint64_t  memadr_offset = 0; // next page to describe
 
-    while (offset < endOfMemoryMap)
+    for (i = 0; i < nranges && memadr_offset < AVAIBLE_MEMORY; i++)
     {
-        EFI_MEMORY_DESCRIPTOR *desc = (EFI_MEMORY_DESCRIPTOR *)(offset);
-        EFI_MEMORY_DESCRIPTOR  desctmp = *desc;
-        desc->NumberOfPages=1;
-        if(desc->PhysicalStart == MEMORY_MAP_ADDR) desc->Type=EfiMaxMemoryType;
-        for (int i = 0; i < desctmp.NumberOfPages ; ++i)
-        {
-            desc->PhysicalStart = memadr_offset;
-            if ( i >= MEMORY_MAP_SIZE / SPAGES ) {desc->Type=EfiConventionalMemory;}
-            memcpy(memmap_offset,offset,UEFI_LP->Memory_Map_Descriptor_Size);
-            memmap_offset+=UEFI_LP->Memory_Map_Descriptor_Size;
-            memadr_offset+=SPAGES;
-            if ( memadr_offset == 0xA0000 ) {memadr_offset=0x100000;} // I thing UEFI wrong, but who i am
-        }
-        *desc = desctmp;        
-        offset += UEFI_LP->Memory_Map_Descriptor_Size;
+        memory_range(i, &r);
+        uint64_t start = r.PhysicalStart;
+        uint64_t end = start + r.NumberOfPages * SPAGES;
+
+        if (end > AVAIBLE_MEMORY)
+            end = AVAIBLE_MEMORY;
+        if (end <= memadr_offset) // out of order or overlapping
+            continue;
+        if (start < memadr_offset)
+            start = memadr_offset;
+
+        // Nothing in the map covers a gap (the legacy VGA hole at 0xA0000, say)
+        memmap_offset = describe_pages(memmap_offset, memadr_offset, start, EfiReservedMemoryType);
+        memmap_offset = describe_pages(memmap_offset, start, end,
+                memory_range_free(&r) ? EfiConventionalMemory : r.Type);
+        memadr_offset = end;
     }
+    describe_pages(memmap_offset, memadr_offset, AVAIBLE_MEMORY, EfiReservedMemoryType);
 
     return 0;
 }
@@ -131,7 +233,6 @@ int init_memory_map()
 int PrintMemoryMap()
 {
 
-    UEFI_LP =  (void *)LP_pointer;
 
     //***********************************************//
     
@@ -189,7 +290,11 @@ int PrintMemoryMap()
 // INFO   TEST   FUCTION
 int LP_info()
 {
-	UEFI_LP=(void *)LP_pointer;
+    if (!UEFI_LP)
+    {
+        cprintf("No loader parameters (legacy boot)\n");
+        return 0;
+    }
 	cprintf("Memory_Map_Descriptor_Size pointer addr %p\r\n", &(UEFI_LP->Memory_Map_Descriptor_Size));
     cprintf("Memory_Map pointer addr %p\r\n", &(UEFI_LP->Memory_Map));
     cprintf("Memory_Map_Size pointer addr %p\r\n", &(UEFI_LP->Memory_Map_Size));
@@ -207,13 +312,50 @@ int LP_info()
 }
 // Return information about addresses in struct LOADER_PARAMS;
 
+// Number of boot modules, 0 if the loader is too old to load any.
+static uint32_t
+module_count()
+{
+    if (!LOADER_PARAMS_HAS(UEFI_LP, LOADER_MODULES))
+        return 0;
+    return UEFI_LP->Number_of_Modules;
+}
+
+// The boot module the loader loaded from a file called 'name', or NULL.
+// Its data stays where the loader put it, in pages we never allocate.
+const BOOT_MODULE *
+boot_module(const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < module_count(); i++)
+        if (strcmp(UEFI_LP->Modules[i].Name, name) == 0)
+            return &UEFI_LP->Modules[i];
+    return NULL;
+}
+
+int PrintBootModules()
+{
+    uint32_t i;
+
+    if (!module_count())
+        cprintf("No boot modules\n");
+    for (i = 0; i < module_count(); i++)
+    {
+        const BOOT_MODULE *m = &UEFI_LP->Modules[i];
+        cprintf("%-24s %08llx-%08llx %8llu bytes\n", m->Name,
+                m->Base, m->Base + m->Pages * SPAGES, m->Size);
+    }
+    return 0;
+}
+
 ///*************************************************************************************///
 // предпологаем, что адрес выровнен по страницам т.е. адрес указывает на начало страницы //
 // для этого достаточно, чтобы последние три цифры адреса тождественно равнялись 0.      //
 ///*************************************************************************************///
 
-EFI_ALLOCATE_ERROR
-AllocatePages( EFI_ALLOCATE_TYPE a_type, EFI_MEMORY_TYPE m_type, UINTN pages, EFI_PHYSICAL_ADDRESS * mem ) 
+static EFI_ALLOCATE_ERROR
+allocate_pages( EFI_ALLOCATE_TYPE a_type, EFI_MEMORY_TYPE m_type, UINTN pages, EFI_PHYSICAL_ADDRESS * mem ) 
 {
     if ((a_type != AllocateAnyPages) && (a_type != AllocateMaxAddress) && (a_type != AllocateAddress)) 
     return EFI_INVALID_PARAMETER; // standart
@@ -228,7 +370,6 @@ AllocatePages( EFI_ALLOCATE_TYPE a_type, EFI_MEMORY_TYPE m_type, UINTN pages, EF
 
     //cprintf("HI HIH IH\n");
 
-    UEFI_LP=(void *)LP_pointer;
     //***********************************************//
     
        uint32_t DungerousPlace = (uint32_t) MEMORY_MAP_ADDR;
@@ -255,7 +396,7 @@ AllocatePages( EFI_ALLOCATE_TYPE a_type, EFI_MEMORY_TYPE m_type, UINTN pages, EF
             
                 if(num_pages == 0)
                 {
-                    * mem = desc->PhysicalStart;
+                    * mem = ((EFI_MEMORY_DESCRIPTOR *)save_offset)->PhysicalStart;
                     for (int i = 0; i < pages; ++i)
                     {
                         EFI_MEMORY_DESCRIPTOR * desctmp = (EFI_MEMORY_DESCRIPTOR *)save_offset;
@@ -300,7 +441,7 @@ AllocatePages( EFI_ALLOCATE_TYPE a_type, EFI_MEMORY_TYPE m_type, UINTN pages, EF
             }
             if(num_pages == 0)
             {
-                * mem = desc->PhysicalStart;
+                * mem = ((EFI_MEMORY_DESCRIPTOR *)save_offset)->PhysicalStart;
                 for (int i = 0; i < pages; ++i)
                 {
                     EFI_MEMORY_DESCRIPTOR * desctmp = (EFI_MEMORY_DESCRIPTOR *)save_offset;
@@ -355,14 +496,13 @@ return EFI_OUT_OF_RESOURCES;
 
 
 
-EFI_ALLOCATE_ERROR
-FreePages(  EFI_PHYSICAL_ADDRESS * mem , UINTN pages ) 
+static EFI_ALLOCATE_ERROR
+free_pages(  EFI_PHYSICAL_ADDRESS * mem , UINTN pages ) 
 {
     if ( (mem != NULL) && (*mem%SPAGES)) return EFI_INVALID_PARAMETER;
 
     if( *mem > AVAIBLE_MEMORY ) return EFI_INVALID_PARAMETER; // we can only use address under
     
-    UEFI_LP=(void *)LP_pointer;
 
     //***********************************************//
     
@@ -398,6 +538,77 @@ FreePages(  EFI_PHYSICAL_ADDRESS * mem , UINTN pages )
     return EFI_SUCCESS;
 }
 
+EFI_ALLOCATE_ERROR
+AllocatePages( EFI_ALLOCATE_TYPE a_type, EFI_MEMORY_TYPE m_type, UINTN pages, EFI_PHYSICAL_ADDRESS * mem ) 
+{
+    EFI_ALLOCATE_ERROR r;
+
+    PROBE();
+    spin_lock(&page_lock);
+    r = allocate_pages(a_type, m_type, pages, mem);
+    spin_unlock(&page_lock);
+    return r;
+}
+
+EFI_ALLOCATE_ERROR
+FreePages(  EFI_PHYSICAL_ADDRESS * mem , UINTN pages ) 
+{
+    EFI_ALLOCATE_ERROR r;
+
+    PROBE();
+    spin_lock(&page_lock);
+    r = free_pages(mem, pages);
+    spin_unlock(&page_lock);
+    return r;
+}
+
+// Allocate up to n single pages of type m_type, not necessarily
+// contiguous, into mem[] with one lock acquisition and one pass over
+// the page map.  Returns how many it found.
+UINTN
+AllocatePageBatch( EFI_MEMORY_TYPE m_type, EFI_PHYSICAL_ADDRESS * mem, UINTN n )
+{
+    uint8_t * offset = (uint8_t *) (uint32_t) MEMORY_MAP_ADDR;
+    uint8_t * endOfMemoryMap = offset + MEMORY_MAP_SIZE;
+    UINTN got = 0;
+
+    PROBE();
+    spin_lock(&page_lock);
+    for (; offset < endOfMemoryMap && got < n; offset += UEFI_LP->Memory_Map_Descriptor_Size)
+    {
+        EFI_MEMORY_DESCRIPTOR * desc = (EFI_MEMORY_DESCRIPTOR *)offset;
+
+        if (desc->Type == EfiConventionalMemory)
+        {
+            desc->Type = m_type;
+            mem[got++] = desc->PhysicalStart;
+        }
+    }
+    spin_unlock(&page_lock);
+    return got;
+}
+
+// Give back n single pages with one lock acquisition.  Page p is
+// entry p of the page map, so there is nothing to search for.
+void
+FreePageBatch( const EFI_PHYSICAL_ADDRESS * mem, UINTN n )
+{
+    uint8_t * startOfMemoryMap = (uint8_t *) (uint32_t) MEMORY_MAP_ADDR;
+    UINTN i;
+
+    PROBE();
+    spin_lock(&page_lock);
+    for (i = 0; i < n; i++)
+    {
+        if ((mem[i] % SPAGES) || mem[i] >= AVAIBLE_MEMORY)
+            continue;
+        EFI_MEMORY_DESCRIPTOR * desc = (EFI_MEMORY_DESCRIPTOR *)(startOfMemoryMap +
+                (uint32_t) (mem[i] / SPAGES) * UEFI_LP->Memory_Map_Descriptor_Size);
+        desc->Type = EfiConventionalMemory;
+    }
+    spin_unlock(&page_lock);
+}
+
 
 
 
@@ -4,5 +4,9 @@
 int LP_info();
 int PrintMemoryMap();
 int init_memory_map();
+int PrintBootModules();
+const BOOT_MODULE *boot_module(const char *name);
 EFI_ALLOCATE_ERROR AllocatePages( EFI_ALLOCATE_TYPE a_type, EFI_MEMORY_TYPE m_type, UINTN pages, EFI_PHYSICAL_ADDRESS * mem );
-EFI_ALLOCATE_ERROR FreePages(  EFI_PHYSICAL_ADDRESS * mem , UINTN pages ); 
\ No newline at end of file
+EFI_ALLOCATE_ERROR FreePages(  EFI_PHYSICAL_ADDRESS * mem , UINTN pages ); 
+UINTN AllocatePageBatch( EFI_MEMORY_TYPE m_type, EFI_PHYSICAL_ADDRESS * mem, UINTN n );
+void FreePageBatch( const EFI_PHYSICAL_ADDRESS * mem, UINTN n );
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <inc/string.h>
 #include <inc/stdarg.h>
 #include <inc/error.h>
+#include <inc/probe.h>
 
 /*
  * Space or zero padding and a field width are supported for the numeric
@@ -82,6 +83,7 @@ void printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...);
 void
 vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 {
+	PROBE();
 	register const char *p;
 	register int ch, err;
 	unsigned long long num;
@@ -1,6 +1,8 @@
 // Basic string routines.  Not hardware optimized, but not shabby.
 
 #include <inc/string.h>
+#include <inc/x86.h>
+#include <inc/probe.h>
 
 // Using assembly for memset/memmove
 // makes some difference on real hardware,
@@ -118,51 +120,134 @@ strfind(const char *s, char c)
 }
 
 #if ASM
+// Below this many bytes the head/body/tail split costs more than it saves.
+#define MEM_SMALL	16
+
+// Does the CPU advertise Enhanced REP MOVSB/STOSB (CPUID.7.0:EBX[9])?
+// If so, plain "rep movsb"/"rep stosb" run at full speed for any alignment
+// and beat the word-at-a-time split.  Detected once, on first use.
+static int erms = -1;
+
+static int
+cpu_has_erms(void)
+{
+	uint32_t max, ebx;
+
+	if (erms < 0) {
+		erms = 0;
+		cpuid(0, &max, 0, 0, 0);
+		if (max >= 7) {
+			cpuid(7, 0, &ebx, 0, 0);
+			erms = (ebx >> 9) & 1;
+		}
+	}
+	return erms;
+}
+
+// Copy n bytes upward from s to d.  Safe for overlapping regions
+// as long as d <= s.  The destination is brought to a word boundary
+// first so that the body is stored a word at a time.
+static void
+copy_forward(char *d, const char *s, size_t n)
+{
+	size_t head, words;
+
+	if (n < MEM_SMALL || cpu_has_erms()) {
+		asm volatile("cld; rep movsb\n"
+			: "+D" (d), "+S" (s), "+c" (n) : : "cc", "memory");
+		return;
+	}
+	head = -(uintptr_t) d & 3;
+	n -= head;
+	words = n / 4;
+	n %= 4;
+	asm volatile("cld; rep movsb\n"
+		: "+D" (d), "+S" (s), "+c" (head) : : "cc", "memory");
+	asm volatile("cld; rep movsl\n"
+		: "+D" (d), "+S" (s), "+c" (words) : : "cc", "memory");
+	asm volatile("cld; rep movsb\n"
+		: "+D" (d), "+S" (s), "+c" (n) : : "cc", "memory");
+}
+
+// Copy n bytes downward, ending just below the addresses d and s.
+// Used when the destination overlaps the end of the source.
+// ERMS does not help with DF set, so always split on word boundaries.
+static void
+copy_backward(char *d, const char *s, size_t n)
+{
+	size_t tail, words;
+	char *dp;
+	const char *sp;
+
+	tail = n < MEM_SMALL ? n : (uintptr_t) d & 3;
+	n -= tail;
+	words = n / 4;
+	n %= 4;
+	// Each rep starts at the highest unit of its piece and walks down.
+	dp = d - 1, sp = s - 1;
+	asm volatile("std; rep movsb\n"
+		: "+D" (dp), "+S" (sp), "+c" (tail) : : "cc", "memory");
+	dp -= 3, sp -= 3;
+	asm volatile("std; rep movsl\n"
+		: "+D" (dp), "+S" (sp), "+c" (words) : : "cc", "memory");
+	dp += 3, sp += 3;
+	asm volatile("std; rep movsb\n"
+		: "+D" (dp), "+S" (sp), "+c" (n) : : "cc", "memory");
+	// Some versions of GCC rely on DF being clear
+	asm volatile("cld" ::: "cc");
+}
+
 void *
 memset(void *v, int c, size_t n)
 {
-	if (n == 0)
-		return v;
-	if ((int)v%4 == 0 && n%4 == 0) {
-		c &= 0xFF;
-		c = (c<<24)|(c<<16)|(c<<8)|c;
-		asm volatile("cld; rep stosl\n"
-			:: "D" (v), "a" (c), "c" (n/4)
-			: "cc", "memory");
-	} else
+	PROBE();
+	char *p;
+	size_t head, words;
+
+	p = v;
+	if (n < MEM_SMALL || cpu_has_erms()) {
 		asm volatile("cld; rep stosb\n"
-			:: "D" (v), "a" (c), "c" (n)
-			: "cc", "memory");
+			: "+D" (p), "+c" (n) : "a" (c) : "cc", "memory");
+		return v;
+	}
+	c &= 0xFF;
+	c = (c<<24)|(c<<16)|(c<<8)|c;
+	head = -(uintptr_t) p & 3;
+	n -= head;
+	words = n / 4;
+	n %= 4;
+	asm volatile("cld; rep stosb\n"
+		: "+D" (p), "+c" (head) : "a" (c) : "cc", "memory");
+	asm volatile("cld; rep stosl\n"
+		: "+D" (p), "+c" (words) : "a" (c) : "cc", "memory");
+	asm volatile("cld; rep stosb\n"
+		: "+D" (p), "+c" (n) : "a" (c) : "cc", "memory");
 	return v;
 }
 
 void *
 memmove(void *dst, const void *src, size_t n)
 {
+	PROBE();
 	const char *s;
 	char *d;
 
 	s = src;
 	d = dst;
-	if (s < d && s + n > d) {
-		s += n;
-		d += n;
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("std; rep movsl\n"
-				:: "D" (d-4), "S" (s-4), "c" (n/4) : "cc", "memory");
-		else
-			asm volatile("std; rep movsb\n"
-				:: "D" (d-1), "S" (s-1), "c" (n) : "cc", "memory");
-		// Some versions of GCC rely on DF being clear
-		asm volatile("cld" ::: "cc");
-	} else {
-		if ((int)s%4 == 0 && (int)d%4 == 0 && n%4 == 0)
-			asm volatile("cld; rep movsl\n"
-				:: "D" (d), "S" (s), "c" (n/4) : "cc", "memory");
-		else
-			asm volatile("cld; rep movsb\n"
-				:: "D" (d), "S" (s), "c" (n) : "cc", "memory");
-	}
+	if (s < d && s + n > d)
+		copy_backward(d + n, s + n, n);
+	else
+		copy_forward(d, s, n);
+	return dst;
+}
+
+void *
+memcpy(void *dst, const void *src, size_t n)
+{
+	PROBE();
+
+	// The regions may not overlap, so there is no direction to pick.
+	copy_forward(dst, src, n);
 	return dst;
 }
 
@@ -201,13 +286,21 @@ memmove(void *dst, const void *src, size_t n)
 
 	return dst;
 }
-#endif
 
 void *
 memcpy(void *dst, const void *src, size_t n)
 {
-	return memmove(dst, src, n);
+	const char *s;
+	char *d;
+
+	s = src;
+	d = dst;
+	while (n-- > 0)
+		*d++ = *s++;
+
+	return dst;
 }
+#endif
 
 int
 memcmp(const void *v1, const void *v2, size_t n)